@@ -0,0 +1,170 @@
+/*
+    SPDX-FileCopyrightText: 2026 KAsync contributors
+
+    SPDX-License-Identifier: GPL-2.0-only OR GPL-3.0-only OR LicenseRef-KDE-Accepted-GPL
+*/
+
+#include "allocationcounter.h"
+
+#include <cstdlib>
+#include <new>
+
+#if defined(__GLIBC__) && !defined(__SANITIZE_ADDRESS__) && !defined(__SANITIZE_THREAD__)
+#define KASYNC_COUNT_MALLOC 1
+#endif
+
+namespace {
+
+// Plain thread locals of the executable are initial-exec, so accessing them
+// does not allocate, which makes them safe to use from within malloc().
+thread_local quint64 threadAllocations = 0;
+thread_local quint64 threadBytes = 0;
+
+inline void countAllocation(std::size_t size)
+{
+    ++threadAllocations;
+    threadBytes += size;
+}
+
+}
+
+#ifdef KASYNC_COUNT_MALLOC
+
+extern "C" {
+void *__libc_malloc(std::size_t size);
+void *__libc_calloc(std::size_t count, std::size_t size);
+void *__libc_realloc(void *ptr, std::size_t size);
+
+void *malloc(std::size_t size)
+{
+    countAllocation(size);
+    return __libc_malloc(size);
+}
+
+void *calloc(std::size_t count, std::size_t size)
+{
+    countAllocation(count * size);
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *ptr, std::size_t size)
+{
+    countAllocation(size);
+    return __libc_realloc(ptr, size);
+}
+}
+
+#endif
+
+namespace {
+
+void *allocate(std::size_t size)
+{
+#ifndef KASYNC_COUNT_MALLOC
+    countAllocation(size);
+#endif
+    if (void *ptr = std::malloc(size ? size : 1)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+}
+
+void *operator new(std::size_t size)
+{
+    return allocate(size);
+}
+
+void *operator new[](std::size_t size)
+{
+    return allocate(size);
+}
+
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept
+{
+    try {
+        return allocate(size);
+    } catch (...) {
+        return nullptr;
+    }
+}
+
+void *operator new[](std::size_t size, const std::nothrow_t &) noexcept
+{
+    try {
+        return allocate(size);
+    } catch (...) {
+        return nullptr;
+    }
+}
+
+void operator delete(void *ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void *ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void *ptr, std::size_t) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void *ptr, std::size_t) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void *ptr, const std::nothrow_t &) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void *ptr, const std::nothrow_t &) noexcept
+{
+    std::free(ptr);
+}
+
+AllocationCounter::AllocationCounter()
+{
+    reset();
+}
+
+void AllocationCounter::reset()
+{
+    mAllocations = threadAllocations;
+    mBytes = threadBytes;
+}
+
+quint64 AllocationCounter::allocations() const
+{
+    return threadAllocations - mAllocations;
+}
+
+quint64 AllocationCounter::bytes() const
+{
+    return threadBytes - mBytes;
+}
+
+bool AllocationCounter::isSupported()
+{
+    // The allocations of a DLL are not routed through the replaced operators
+#ifdef Q_OS_WIN
+    return false;
+#else
+    return true;
+#endif
+}
+
+bool AllocationCounter::countsMalloc()
+{
+#ifdef KASYNC_COUNT_MALLOC
+    return true;
+#else
+    return false;
+#endif
+}
@@ -0,0 +1,48 @@
+/*
+    SPDX-FileCopyrightText: 2026 KAsync contributors
+
+    SPDX-License-Identifier: GPL-2.0-only OR GPL-3.0-only OR LicenseRef-KDE-Accepted-GPL
+*/
+
+#ifndef KASYNC_ALLOCATIONCOUNTER_H
+#define KASYNC_ALLOCATIONCOUNTER_H
+
+#include <QtGlobal>
+
+/**
+ * Counts the heap allocations made by the current thread during the
+ * lifetime of the counter.
+ *
+ * Linking the kasync_testsupport library replaces the global operator new
+ * and delete. With glibc, malloc(), calloc() and realloc() are hooked as
+ * well, which also covers allocations by the Qt containers.
+ */
+class AllocationCounter
+{
+public:
+    AllocationCounter();
+
+    /**
+     * Restarts counting from zero.
+     */
+    void reset();
+
+    quint64 allocations() const;
+    quint64 bytes() const;
+
+    /**
+     * Whether allocations of the KAsync library are visible to the counter.
+     */
+    static bool isSupported();
+
+    /**
+     * Whether malloc() and friends are counted in addition to operator new.
+     */
+    static bool countsMalloc();
+
+private:
+    quint64 mAllocations;
+    quint64 mBytes;
+};
+
+#endif
@@ -0,0 +1,242 @@
+/*
+    SPDX-FileCopyrightText: 2026 KAsync contributors
+
+    SPDX-License-Identifier: GPL-2.0-only OR GPL-3.0-only OR LicenseRef-KDE-Accepted-GPL
+*/
+
+// Krazy mistakes job.exec() for QDialog::exec() and urges us to use QPointer
+//krazy:excludeall=crashy
+
+#include "../src/async.h"
+#include "allocationcounter.h"
+
+#include <QObject>
+#include <QtTest/QTest>
+
+#include <numeric>
+
+#define VERIFY_BUDGET(allocations, budget) \
+    do { \
+        const quint64 count = allocations; \
+        QVERIFY2(count <= quint64(budget), qPrintable(QStringLiteral("%1 allocations exceed the budget of %2").arg(count).arg(budget))); \
+    } while (false)
+
+/**
+ * Asserts upper bounds for the number of heap allocations per exec() of
+ * some canonical job chains.
+ *
+ * The budgets leave about 15% of headroom over the numbers measured on
+ * Linux with glibc, where the allocations of the Qt containers are counted
+ * as well. If a change reduces the number of allocations, lower the budget
+ * accordingly.
+ */
+class AllocationTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void initTestCase();
+
+    void testSyncChain();
+    void testForEach();
+    void testNestedJob();
+    void testDoWhile();
+    void testExecSync();
+    void testThen();
+    void testAddToContext();
+    void testPreparedJob();
+    void testWaitForCompletion();
+
+private:
+    template<typename Job, typename ... In>
+    static quint64 countAllocations(Job &job, In ... in)
+    {
+        // Warm up, so that lazily created global state does not count
+        job.exec(in ...).waitForFinished();
+
+        AllocationCounter counter;
+        {
+            auto future = job.exec(in ...);
+            future.waitForFinished();
+        }
+        return counter.allocations();
+    }
+};
+
+void AllocationTest::initTestCase()
+{
+    if (!AllocationCounter::isSupported()) {
+        QSKIP("Allocations cannot be counted on this platform");
+    }
+    if (!AllocationCounter::countsMalloc()) {
+        QSKIP("The budgets only apply if malloc() is counted");
+    }
+}
+
+void AllocationTest::testSyncChain()
+{
+    auto job = KAsync::start<int>([] {
+            return 1;
+        })
+        .then([](int i) {
+            return i + 1;
+        })
+        .then([](int i) {
+            return i + 1;
+        });
+
+    VERIFY_BUDGET(countAllocations(job), 4);
+}
+
+void AllocationTest::testForEach()
+{
+    QVector<int> list(1000);
+    std::iota(list.begin(), list.end(), 0);
+
+    int sum = 0;
+    auto job = KAsync::forEach<QVector<int>>(KAsync::start<void, int>([&sum](int i) {
+        sum += i;
+    }));
+
+    VERIFY_BUDGET(countAllocations(job, list), 5800);
+}
+
+void AllocationTest::testNestedJob()
+{
+    auto job = KAsync::start<int>([] {
+            return KAsync::start<int>([] {
+                return 1;
+            });
+        })
+        .then([](int i) {
+            return i + 1;
+        });
+
+    VERIFY_BUDGET(countAllocations(job), 10);
+}
+
+void AllocationTest::testDoWhile()
+{
+    int iteration = 0;
+    auto job = KAsync::start<void>([&iteration] {
+            iteration = 0;
+        })
+        .then(KAsync::doWhile([&iteration] {
+            return KAsync::value(++iteration < 100 ? KAsync::Continue : KAsync::Break);
+        }));
+
+    VERIFY_BUDGET(countAllocations(job), 2100);
+}
+
+void AllocationTest::testExecSync()
+{
+    auto job = KAsync::start<int, int>([](int i) {
+            return i + 1;
+        })
+        .then([](int i) {
+            return i * 1.5;
+        })
+        .then([](const KAsync::Error &error, double d) {
+            return error ? 0 : static_cast<int>(d);
+        })
+        .then([](int i) {
+            return i * 2;
+        });
+
+    QCOMPARE(job.execSync(1).value(), 6);
+
+    AllocationCounter counter;
+    const auto result = job.execSync(1);
+    const quint64 allocations = counter.allocations();
+    QCOMPARE(result.value(), 6);
+    VERIFY_BUDGET(allocations, 0);
+}
+
+void AllocationTest::testThen()
+{
+    qDebug() << "sizeof(ExecutorBase):" << sizeof(KAsync::Private::ExecutorBase)
+             << "sizeof(Executor<int, int>):" << sizeof(KAsync::Private::Executor<int, int>);
+
+    const int steps = 100;
+    auto job = KAsync::start<int>([] {
+            return 0;
+        });
+
+    AllocationCounter counter;
+    for (int i = 0; i < steps; ++i) {
+        job = job.then([](int i) {
+            return i + 1;
+        });
+    }
+    const quint64 allocations = counter.allocations();
+    qDebug() << "Per then():" << allocations / steps << "allocations," << counter.bytes() / steps << "bytes";
+
+    QCOMPARE(job.exec().value(), steps);
+    VERIFY_BUDGET(allocations, 115);
+}
+
+void AllocationTest::testAddToContext()
+{
+    const auto anchor = QSharedPointer<int>::create();
+    auto job = KAsync::null<void>();
+    job.addToContext(anchor);
+
+    // Smart pointers are stored inline, only the storage of the context grows
+    AllocationCounter counter;
+    for (int i = 0; i < 100; ++i) {
+        job.addToContext(anchor);
+    }
+    const quint64 allocations = counter.allocations();
+    VERIFY_BUDGET(allocations, 10);
+}
+
+void AllocationTest::testPreparedJob()
+{
+    auto syncJob = KAsync::start<int, int>([](int i) {
+            return i + 1;
+        })
+        .then([](int i) {
+            return i * 2;
+        });
+    auto preparedSync = syncJob.prepare();
+    QCOMPARE(preparedSync.exec(1).value(), 4);
+    // Only the returned Future is allocated
+    VERIFY_BUDGET(countAllocations(preparedSync, 1), 1);
+
+    auto asyncJob = KAsync::start<int, int>([](int i, KAsync::Future<int> &future) {
+            future.setValue(i + 1);
+            future.setFinished();
+        })
+        .then([](int i) {
+            return i * 2;
+        });
+    auto preparedAsync = asyncJob.prepare();
+    QCOMPARE(preparedAsync.exec(1).value(), 4);
+    const quint64 allocations = countAllocations(asyncJob, 1);
+    const quint64 preparedAllocations = countAllocations(preparedAsync, 1);
+    QVERIFY2(preparedAllocations < allocations,
+             qPrintable(QStringLiteral("PreparedJob: %1 allocations, Job: %2").arg(preparedAllocations).arg(allocations)));
+    VERIFY_BUDGET(preparedAllocations, 4);
+}
+
+void AllocationTest::testWaitForCompletion()
+{
+    QVector<KAsync::Future<void>> futures(100000);
+    auto job = KAsync::waitForCompletion(futures);
+    QVector<KAsync::Future<void>> none;
+    QVERIFY(KAsync::waitForCompletion(none).exec().isFinished());
+
+    // The allocations do not depend on the number of futures
+    AllocationCounter counter;
+    auto future = job.exec();
+    for (KAsync::Future<void> f : qAsConst(futures)) {
+        f.setFinished();
+    }
+    const quint64 allocations = counter.allocations();
+    QVERIFY(future.isFinished());
+    VERIFY_BUDGET(allocations, 7);
+}
+
+QTEST_GUILESS_MAIN(AllocationTest)
+
+#include "allocationtest.moc"
@@ -12,10 +12,15 @@
 #include <QObject>
 #include <QString>
 #include <QTimer>
+#include <QElapsedTimer>
 #include <QtTest/QTest>
 #include <QDebug>
 
+#include <atomic>
 #include <functional>
+#include <memory>
+#include <numeric>
+#include <thread>
 
 #define COMPARERET(actual, expected, retval) \
 do {\
@@ -56,10 +61,23 @@ private Q_SLOTS:
     void testAsyncSerialEach();
     void noTemplateArguments();
     void testValueJob();
-
-    void benchmarkSyncThenExecutor();
-    void benchmarkFutureThenExecutor();
-    void benchmarkThenExecutor();
+    void testTracer();
+    void testMetrics();
+    void testSlowExecutionReport();
+    void testLiveExecutions();
+    void testObjectCounts();
+    void testVirtualTime();
+    void testExecSync();
+    void testFusedSteps();
+    void testNestedJobContext();
+    void testEagerRelease();
+    void testGuardCancelsPendingSteps();
+    void testExecutionValues();
+    void testConcurrentExec();
+    void testPreparedJob();
+    void testWaitForCompletion();
+    void testWhenAll();
+    void testParallel();
 
 private:
     template<typename T>
@@ -569,6 +587,42 @@ void AsyncTest::testContext()
         }
     }
     QVERIFY(!refToObj);
+
+    // Values of any type, stored inline or not, live as long as the job
+    {
+        struct Anchor {
+            std::shared_ptr<int> counter;
+            char padding[64];
+        };
+        auto small = std::make_shared<int>();
+        auto large = std::make_shared<int>();
+        {
+            auto job = KAsync::null<void>();
+            job.addToContext(small);
+            job.addToContext(Anchor{large, {}});
+            QCOMPARE(small.use_count(), 2l);
+            QCOMPARE(large.use_count(), 2l);
+            job.exec().waitForFinished();
+            QCOMPARE(small.use_count(), 2l);
+            QCOMPARE(large.use_count(), 2l);
+        }
+        QCOMPARE(small.use_count(), 1l);
+        QCOMPARE(large.use_count(), 1l);
+
+        // Values are moved when the storage of the context grows
+        {
+            auto job = KAsync::null<void>();
+            for (int i = 0; i < 5; ++i) {
+                job.addToContext(Anchor{large, {}});
+                job.addToContext(small);
+            }
+            QCOMPARE(small.use_count(), 6l);
+            QCOMPARE(large.use_count(), 6l);
+            job.exec().waitForFinished();
+        }
+        QCOMPARE(small.use_count(), 1l);
+        QCOMPARE(large.use_count(), 1l);
+    }
 }
 
 void AsyncTest::testGuard()
@@ -863,45 +917,6 @@ void AsyncTest::testAsyncSerialEach()
     }
 }
 
-void AsyncTest::benchmarkSyncThenExecutor()
-{
-    auto job = KAsync::start<int>(
-        []() {
-            return 1;
-        });
-
-    QBENCHMARK {
-       job.exec();
-    }
-}
-
-void AsyncTest::benchmarkFutureThenExecutor()
-{
-    auto job = KAsync::start<int>(
-        [](KAsync::Future<int> &f) {
-            f.setResult(1);
-        });
-
-    QBENCHMARK {
-       job.exec();
-    }
-}
-
-void AsyncTest::benchmarkThenExecutor()
-{
-    // auto job = KAsync::start<int>(
-    //     []() {
-    //         return KAsync::value(1);
-    //     });
-    
-    //This is exactly the same as the future version (due to it's implementation).
-    auto job = KAsync::value(1);
-
-    QBENCHMARK {
-       job.exec();
-    }
-}
-
 //Ensure we don't have to define the template arguments
 void AsyncTest::noTemplateArguments()
 {
@@ -1004,6 +1019,976 @@ void AsyncTest::testValueJob()
     }
 }
 
+void AsyncTest::testTracer()
+{
+    KAsync::Tracer::clear();
+    KAsync::Tracer::setEnabled(true);
+    auto future = KAsync::start<int>([] {
+            return 42;
+        })
+        .then([](int i) {
+            return i * 2;
+        })
+        .exec();
+    KAsync::Tracer::setEnabled(false);
+    QVERIFY(future.isFinished());
+    QCOMPARE(future.value(), 84);
+
+    const QByteArray trace = KAsync::Tracer::chromeTrace();
+    QVERIFY(trace.startsWith("{\"traceEvents\":["));
+    QCOMPARE(trace.count("\"ph\":\"b\""), 2);
+    QCOMPARE(trace.count("\"ph\":\"n\""), 2);
+    QCOMPARE(trace.count("\"ph\":\"e\""), 2);
+
+    //Nothing is recorded while the tracer is disabled
+    KAsync::Tracer::clear();
+    KAsync::null().exec();
+    QVERIFY(!KAsync::Tracer::chromeTrace().contains("\"ph\":\"b\""));
+
+    // The events of finished threads are kept until they are cleared
+    KAsync::Tracer::setEnabled(true);
+    std::thread([] {
+        KAsync::null().exec();
+    }).join();
+    KAsync::Tracer::setEnabled(false);
+    const int threads = KAsync::Tracer::chromeTrace().count("thread_name");
+    KAsync::Tracer::clear();
+    QCOMPARE(KAsync::Tracer::chromeTrace().count("thread_name"), threads - 1);
+
+    // The trace can be exported while other threads record events
+    KAsync::Tracer::setEnabled(true);
+    std::atomic<bool> stop{false};
+    std::thread recorder([&stop] {
+        while (!stop) {
+            KAsync::null().exec();
+        }
+    });
+    for (int i = 0; i < 20; ++i) {
+        QVERIFY(KAsync::Tracer::chromeTrace().startsWith("{\"traceEvents\":["));
+    }
+    stop = true;
+    recorder.join();
+    KAsync::Tracer::setEnabled(false);
+    KAsync::Tracer::clear();
+}
+
+void AsyncTest::testMetrics()
+{
+    KAsync::Metrics::reset();
+    KAsync::Metrics::setEnabled(true);
+    auto errorJob = KAsync::start<int>([](KAsync::Future<int> &future) {
+            future.setError(1, QStringLiteral("error"));
+        })
+        .named("metricsError");
+
+    for (int i = 0; i < 3; ++i) {
+        KAsync::start<int>([] { return 1; }).named("metricsStart").exec().waitForFinished();
+    }
+    errorJob.exec().waitForFinished();
+    KAsync::Metrics::setEnabled(false);
+    // Not measured while disabled
+    errorJob.exec().waitForFinished();
+
+    const auto metrics = KAsync::Metrics::snapshot();
+    const auto find = [&metrics](const QByteArray &name) {
+        return std::find_if(metrics.cbegin(), metrics.cend(), [&name](const KAsync::StepMetrics &m) {
+            return m.name == name;
+        });
+    };
+    const auto start = find("metricsStart");
+    QVERIFY(start != metrics.cend());
+    QCOMPARE(start->invocations, 3ull);
+    QCOMPARE(start->errors, 0ull);
+    QCOMPARE(start->latencyHistogram.size(), 64);
+    QCOMPARE(std::accumulate(start->latencyHistogram.cbegin(), start->latencyHistogram.cend(), 0ull), 3ull);
+    QVERIFY(start->maxWallTime <= start->totalWallTime);
+    QVERIFY(start->latencyPercentile(100) >= start->maxWallTime);
+
+    const auto error = find("metricsError");
+    QVERIFY(error != metrics.cend());
+    QCOMPARE(error->invocations, 1ull);
+    QCOMPARE(error->errors, 1ull);
+
+    // An asynchronous step is done before the steps following it run
+    KAsync::Metrics::reset();
+    KAsync::Metrics::setEnabled(true);
+    const auto asyncStep = [](KAsync::Future<void> &future) {
+        QTimer::singleShot(0, [&future] {
+            future.setFinished();
+        });
+    };
+    KAsync::start<void>(asyncStep)
+        .then<void>(asyncStep)
+        .named("metricsAsync")
+        .then([] {
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        })
+        .exec()
+        .waitForFinished();
+    KAsync::Metrics::setEnabled(false);
+    const auto asyncMetrics = KAsync::Metrics::snapshot();
+    const auto async = std::find_if(asyncMetrics.cbegin(), asyncMetrics.cend(), [](const KAsync::StepMetrics &m) {
+        return m.name == "metricsAsync";
+    });
+    QVERIFY(async != asyncMetrics.cend());
+    QCOMPARE(async->invocations, 1ull);
+    QVERIFY(async->maxWallTime < 50 * 1000 * 1000);
+}
+
+void AsyncTest::testSlowExecutionReport()
+{
+    QStringList reports;
+    KAsync::Introspection::setSlowExecutionHandler([&reports](const QString &report) {
+        reports << report;
+    });
+    KAsync::Introspection::setSlowExecutionThreshold(5);
+
+    auto job = KAsync::start<void>([] {
+            return KAsync::wait(20).named("nestedWait");
+        })
+        .named("slowStart")
+        .then([] {})
+        .named("slowEnd");
+    job.exec().waitForFinished();
+
+    QCOMPARE(reports.size(), 1);
+    const QString report = reports.first();
+    QVERIFY(report.startsWith(QStringLiteral("Slow execution")));
+    QVERIFY(report.contains(QStringLiteral("  * slowStart wait")));
+    QVERIFY(report.contains(QStringLiteral("    * nestedWait wait")));
+    QVERIFY(report.contains(QStringLiteral("  * slowEnd wait")));
+    QVERIFY(report.indexOf(QStringLiteral("nestedWait")) < report.indexOf(QStringLiteral("slowEnd")));
+
+    KAsync::Introspection::setSlowExecutionThreshold(1000);
+    job.exec().waitForFinished();
+    QCOMPARE(reports.size(), 1);
+
+    KAsync::Introspection::setSlowExecutionThreshold(0);
+    KAsync::Introspection::setSlowExecutionHandler({});
+}
+
+void AsyncTest::testLiveExecutions()
+{
+    KAsync::Introspection::setLiveExecutionTracking(true);
+
+    QObject guard;
+    guard.setObjectName(QStringLiteral("stuckGuard"));
+    KAsync::Future<void> *pending = nullptr;
+    auto future = KAsync::start<void>([&pending](KAsync::Future<void> &future) {
+            pending = &future;
+        })
+        .named("stuckStep")
+        .guard(&guard)
+        .exec();
+    KAsync::start<void>([] {}).exec();
+
+    auto live = KAsync::Introspection::liveExecutions();
+    QCOMPARE(live.size(), 1);
+    QCOMPARE(live.first().currentStep, QStringLiteral("stuckStep"));
+    QCOMPARE(live.first().guard.data(), &guard);
+
+    QStringList reports;
+    KAsync::Introspection::setWatchdogHandler([&reports](const QString &report) {
+        reports << report;
+    });
+    KAsync::Introspection::startWatchdog(0, 10000, 10);
+    QTRY_COMPARE(reports.size(), 1);
+    QTest::qWait(50);
+    KAsync::Introspection::stopWatchdog();
+    QCOMPARE(reports.size(), 1);
+    QVERIFY(reports.first().contains(QStringLiteral("current step: stuckStep")));
+    QVERIFY(reports.first().contains(QStringLiteral("stuckGuard")));
+
+    pending->setFinished();
+    QVERIFY(future.isFinished());
+    QVERIFY(KAsync::Introspection::liveExecutions().isEmpty());
+
+    KAsync::Introspection::setWatchdogHandler({});
+    KAsync::Introspection::setLiveExecutionTracking(false);
+}
+
+void AsyncTest::testObjectCounts()
+{
+    using KAsync::Metrics;
+    using KAsync::TrackedObject;
+
+    const auto executors = Metrics::objectCount(TrackedObject::Executor).live;
+    const auto executions = Metrics::objectCount(TrackedObject::Execution).live;
+    const auto futures = Metrics::objectCount(TrackedObject::FuturePrivate).live;
+    const auto watchers = Metrics::objectCount(TrackedObject::FutureWatcher).live;
+    const auto contexts = Metrics::objectCount(TrackedObject::ExecutionContext).live;
+    // The peaks are only tracked while metrics are enabled
+    Metrics::setEnabled(true);
+    Metrics::resetPeakObjectCounts();
+
+    {
+        auto job = KAsync::start<int>([] {
+                return 1;
+            })
+            .then([](int i) {
+                return i + 1;
+            })
+            .then([](int i) {
+                return i + 1;
+            });
+        QCOMPARE(Metrics::objectCount(TrackedObject::Executor).live, executors + 3);
+
+        auto future = job.exec();
+        QCOMPARE(future.value(), 3);
+        // The synchronous steps are fused into the last one
+        QCOMPARE(Metrics::objectCount(TrackedObject::Execution).peak, executions + 1);
+        QCOMPARE(Metrics::objectCount(TrackedObject::ExecutionContext).peak, contexts + 1);
+
+        Metrics::setEnabled(false);
+        Metrics::resetPeakObjectCounts();
+        QCOMPARE(job.exec().value(), 3);
+        QCOMPARE(Metrics::objectCount(TrackedObject::ExecutionContext).peak, contexts);
+    }
+
+    QCOMPARE(Metrics::objectCount(TrackedObject::Executor).live, executors);
+    QCOMPARE(Metrics::objectCount(TrackedObject::Execution).live, executions);
+    QCOMPARE(Metrics::objectCount(TrackedObject::FuturePrivate).live, futures);
+    QCOMPARE(Metrics::objectCount(TrackedObject::FutureWatcher).live, watchers);
+    QCOMPARE(Metrics::objectCount(TrackedObject::ExecutionContext).live, contexts);
+    QVERIFY(Metrics::objectCountReport().contains(QStringLiteral("Execution ")));
+}
+
+void AsyncTest::testVirtualTime()
+{
+    {
+        KAsync::VirtualTimerSource timers(false);
+        QStringList fired;
+        timers.singleShot(20, [&] { fired << QStringLiteral("b"); });
+        timers.singleShot(10, [&] {
+            fired << QStringLiteral("a");
+            timers.singleShot(10, [&] { fired << QStringLiteral("c"); });
+        });
+        timers.singleShot(30, [&] { fired << QStringLiteral("d"); });
+
+        timers.advance(20);
+        QCOMPARE(timers.now(), 20ll);
+        QCOMPARE(fired, QStringList() << QStringLiteral("a") << QStringLiteral("b") << QStringLiteral("c"));
+        QVERIFY(timers.advanceToNextDeadline());
+        QCOMPARE(timers.now(), 30ll);
+        QCOMPARE(timers.pendingTimers(), 0);
+        QVERIFY(!timers.advanceToNextDeadline());
+
+        // Destroying the context stops the timer
+        auto context = new QObject;
+        timers.singleShot(10, context, [&] { fired << QStringLiteral("e"); });
+        QCOMPARE(timers.pendingTimers(), 1);
+        delete context;
+        QCOMPARE(timers.pendingTimers(), 0);
+        timers.advance(10);
+        QCOMPARE(fired.size(), 4);
+    }
+
+    KAsync::VirtualTimerSource timers;
+    KAsync::TimerSource::setInstance(&timers);
+
+    // Retry with exponential backoff, waiting a total of 1023 hours
+    const int hour = 60 * 60 * 1000;
+    int attempts = 0;
+    int backoff = hour;
+    auto job = KAsync::doWhile([&] {
+        return KAsync::wait(backoff).then([&] {
+            if (++attempts == 10) {
+                return KAsync::Break;
+            }
+            backoff *= 2;
+            return KAsync::Continue;
+        });
+    });
+
+    QElapsedTimer elapsed;
+    elapsed.start();
+    job.exec().waitForFinished();
+    QVERIFY(elapsed.elapsed() < 1000);
+    QCOMPARE(attempts, 10);
+    QCOMPARE(timers.now(), 1023ll * hour);
+
+    KAsync::TimerSource::setInstance(nullptr);
+    QVERIFY(KAsync::TimerSource::instance() != &timers);
+}
+
+void AsyncTest::testExecSync()
+{
+    {
+        auto result = KAsync::value(2)
+            .then([](int i) {
+                return i * 2;
+            })
+            .onError([](const KAsync::Error &) {})
+            .then([](const KAsync::Error &error, int i) {
+                return error ? QString() : QString::number(i);
+            })
+            .execSync();
+        QVERIFY(!result.hasError());
+        QCOMPARE(result.value(), QStringLiteral("4"));
+    }
+
+    {
+        auto job = KAsync::start<int, int>([](int i) {
+            return i + 1;
+        });
+        QCOMPARE(job.execSync(1).value(), 2);
+        QCOMPARE(job.execSync(2).value(), 3);
+        // Same chain, run asynchronously
+        QCOMPARE(job.exec(3).value(), 4);
+    }
+
+    {
+        bool run = false;
+        auto guard = new QObject;
+        auto job = KAsync::start<void>([&run] {
+                run = true;
+            })
+            .guard(guard);
+        QVERIFY(job.execSync());
+        QVERIFY(run);
+
+        run = false;
+        delete guard;
+        QVERIFY(job.execSync());
+        QVERIFY(!run);
+    }
+
+    {
+        bool run = false;
+        auto result = KAsync::start<int>([&run] {
+                run = true;
+                return 1;
+            })
+            .then<int, int>([](int i, KAsync::Future<int> &future) {
+                future.setResult(i);
+            })
+            .execSync();
+        QVERIFY(result.hasError());
+        QVERIFY(!run);
+    }
+}
+
+void AsyncTest::testFusedSteps()
+{
+    using KAsync::Metrics;
+    using KAsync::TrackedObject;
+
+    // Synchronous steps following an asynchronous one
+    {
+        QList<int> steps;
+        KAsync::Future<int> *pending = nullptr;
+        auto job = KAsync::start<int>([&pending](KAsync::Future<int> &future) {
+                pending = &future;
+            })
+            .then([&steps](int i) {
+                steps << 1;
+                return i + 1;
+            })
+            .then([&steps](int i) {
+                steps << 2;
+                return i * 2;
+            });
+
+        const auto executions = Metrics::objectCount(TrackedObject::Execution).live;
+        auto future = job.exec();
+        QCOMPARE(Metrics::objectCount(TrackedObject::Execution).live, executions + 2);
+        QVERIFY(steps.isEmpty());
+        pending->setResult(1);
+        QVERIFY(future.isFinished());
+        QCOMPARE(future.value(), 4);
+        QCOMPARE(steps, (QList<int>{1, 2}));
+    }
+
+    // Errors are propagated through fused steps and handled by them
+    {
+        auto future = KAsync::error<int>(3, QStringLiteral("fused"))
+            .then([](int i) {
+                return i + 1;
+            })
+            .then([](const KAsync::Error &error, int) {
+                return error.errorCode;
+            })
+            .then([](int i) {
+                return i;
+            })
+            .exec();
+        QVERIFY(future.isFinished());
+        QVERIFY(!future.hasError());
+        QCOMPARE(future.value(), 3);
+    }
+    {
+        KAsync::Error handled;
+        auto future = KAsync::error<int>(3, QStringLiteral("fused"))
+            .onError([&handled](const KAsync::Error &error) {
+                handled = error;
+            })
+            .then([](int i) {
+                return i + 1;
+            })
+            .exec();
+        QVERIFY(!future.hasError());
+        QCOMPARE(future.value(), 1);
+        QCOMPARE(handled.errorMessage, QStringLiteral("fused"));
+
+        future = KAsync::value(1)
+            .onError([&handled](const KAsync::Error &) {
+                handled = {};
+            })
+            .then([](int i) {
+                return i + 1;
+            })
+            .exec();
+        QCOMPARE(future.value(), 2);
+        QCOMPARE(handled.errorMessage, QStringLiteral("fused"));
+    }
+
+    // Deleting a guard in a fused step skips the remaining steps
+    {
+        bool run = false;
+        auto guard = new QObject;
+        KAsync::Job<void> job = KAsync::start<int>([&guard] {
+                delete guard;
+                return 1;
+            })
+            .then([&run](int i) {
+                run = true;
+                return i;
+            })
+            .guard(guard);
+        auto future = job.exec();
+        QVERIFY(future.isFinished());
+        QVERIFY(!run);
+    }
+}
+
+void AsyncTest::testNestedJobContext()
+{
+    using KAsync::Metrics;
+    using KAsync::TrackedObject;
+
+    // Nested jobs run in the context of the outer job
+    {
+        auto job = KAsync::start<int>([] {
+                return KAsync::start<int>([] {
+                    return 1;
+                });
+            })
+            .then([](int i) {
+                return i + 1;
+            });
+        Metrics::setEnabled(true);
+        Metrics::resetPeakObjectCounts();
+        const auto contexts = Metrics::objectCount(TrackedObject::ExecutionContext).live;
+        QCOMPARE(job.exec().value(), 2);
+        QCOMPARE(Metrics::objectCount(TrackedObject::ExecutionContext).peak, contexts + 1);
+        Metrics::setEnabled(false);
+    }
+
+    // The guards of the outer job apply to the nested job
+    {
+        bool run = false;
+        KAsync::Future<void> *pending = nullptr;
+        auto guard = new QObject;
+        auto future = KAsync::start<void>([&] {
+                return KAsync::start<void>([&pending](KAsync::Future<void> &future) {
+                        pending = &future;
+                    })
+                    .then([&run] {
+                        run = true;
+                    });
+            })
+            .guard(guard)
+            .exec();
+        QVERIFY(pending);
+        delete guard;
+        pending->setFinished();
+        QVERIFY(future.isFinished());
+        QVERIFY(!run);
+    }
+
+    // The guards of a nested job do not apply to the outer job
+    {
+        bool run = false;
+        auto guard = new QObject;
+        auto future = KAsync::start<void>([&guard] {
+                return KAsync::start<void>([&guard] {
+                        delete guard;
+                    })
+                    .guard(guard);
+            })
+            .then([&run] {
+                run = true;
+            })
+            .exec();
+        QVERIFY(future.isFinished());
+        QVERIFY(run);
+    }
+}
+
+namespace {
+struct Buffer {
+    Buffer() { ++live; }
+    ~Buffer() { --live; }
+    static int live;
+};
+int Buffer::live = 0;
+}
+
+void AsyncTest::testEagerRelease()
+{
+    using KAsync::Metrics;
+    using KAsync::TrackedObject;
+    using BufferPtr = QSharedPointer<Buffer>;
+
+    const auto executions = Metrics::objectCount(TrackedObject::Execution).live;
+
+    auto step = [](BufferPtr, KAsync::Future<BufferPtr> &future) {
+        QTimer::singleShot(0, [&future] {
+            future.setValue(BufferPtr::create());
+            future.setFinished();
+        });
+    };
+    auto job = KAsync::start<BufferPtr>([](KAsync::Future<BufferPtr> &future) {
+            future.setValue(BufferPtr::create());
+            future.setFinished();
+        });
+    for (int i = 0; i < 5; ++i) {
+        job = job.then<BufferPtr, BufferPtr>(step);
+    }
+
+    int liveBuffers = -1;
+    qint64 liveExecutions = -1;
+    auto future = job.then([&](const BufferPtr &) {
+            liveBuffers = Buffer::live;
+            liveExecutions = Metrics::objectCount(TrackedObject::Execution).live - executions;
+        })
+        .exec();
+    future.waitForFinished();
+
+    // Only the input of the running step is left, and only the executions of
+    // the last steps are still alive
+    QCOMPARE(liveBuffers, 1);
+    QVERIFY(liveExecutions <= 3);
+
+    // Synchronous steps that had to wait release their predecessor as well.
+    // The steps are named, so that each of them has an execution.
+    liveExecutions = -1;
+    auto chain = KAsync::start<void>([](KAsync::Future<void> &future) {
+            QTimer::singleShot(0, [&future] {
+                future.setFinished();
+            });
+        })
+        .then([] {}).named("eagerReleaseFirst")
+        .then([] {}).named("eagerReleaseSecond")
+        .then<void>([&](KAsync::Future<void> &future) {
+            QTimer::singleShot(0, [&] {
+                liveExecutions = Metrics::objectCount(TrackedObject::Execution).live - executions;
+                future.setFinished();
+            });
+        })
+        .then([] {});
+    chain.exec().waitForFinished();
+    // Only the running step and the last step are left
+    QCOMPARE(liveExecutions, 2);
+}
+
+void AsyncTest::testGuardCancelsPendingSteps()
+{
+    KAsync::VirtualTimerSource timers(false);
+    KAsync::TimerSource::setInstance(&timers);
+
+    // Destroying the guard finishes a pending wait() right away
+    {
+        bool run = false;
+        auto guard = new QObject;
+        auto future = KAsync::wait(1000)
+            .then([&run] {
+                run = true;
+            })
+            .guard(guard)
+            .exec();
+        QVERIFY(!future.isFinished());
+        delete guard;
+        QVERIFY(future.isFinished());
+        QVERIFY(!run);
+        // The timer is dropped with the execution
+        QCOMPARE(timers.pendingTimers(), 0);
+
+        timers.advance(1000);
+        QVERIFY(!run);
+    }
+
+    // Including the steps of a nested job with guards of its own
+    {
+        bool run = false;
+        auto guard = new QObject;
+        QObject innerGuard;
+        auto future = KAsync::start<void>([&innerGuard] {
+                return KAsync::wait(1000).guard(&innerGuard);
+            })
+            .then([&run] {
+                run = true;
+            })
+            .guard(guard)
+            .exec();
+        QVERIFY(!future.isFinished());
+        delete guard;
+        QVERIFY(future.isFinished());
+        QVERIFY(!run);
+        QCOMPARE(timers.pendingTimers(), 0);
+    }
+
+    // All running executions of a job share the guard
+    {
+        auto guard = new QObject;
+        auto job = KAsync::wait(1000).guard(guard);
+        QVector<KAsync::Future<void>> futures;
+        for (int i = 0; i < 3; ++i) {
+            futures << job.exec();
+        }
+        delete guard;
+        for (const auto &future : qAsConst(futures)) {
+            QVERIFY(future.isFinished());
+        }
+        QCOMPARE(timers.pendingTimers(), 0);
+    }
+
+    // Unguarded executions are not affected
+    {
+        auto future = KAsync::wait(1000).exec();
+        QVERIFY(!future.isFinished());
+        timers.advance(1000);
+        QVERIFY(future.isFinished());
+    }
+
+    QCOMPARE(timers.pendingTimers(), 0);
+    KAsync::TimerSource::setInstance(nullptr);
+}
+
+void AsyncTest::testExecutionValues()
+{
+    struct RequestId {
+        int id;
+    };
+
+    auto requestId = [] {
+        const auto value = KAsync::executionValue<RequestId>();
+        return value ? value->id : -1;
+    };
+
+    auto job = KAsync::start<int, int>([&](int i) {
+            return i + requestId();
+        })
+        .then<int, int>([&](int i, KAsync::Future<int> &future) {
+            future.setValue(i + requestId());
+            future.setFinished();
+        })
+        .then([&](int i) {
+            // Nested jobs see the values of the outer execution, also when
+            // they get a context of their own
+            return KAsync::start<int>([&, i] {
+                    return i + requestId();
+                })
+                .guard(this);
+        })
+        .then([&](int i) {
+            return QString::number(i) + *KAsync::executionValue<QString>();
+        });
+
+    KAsync::ExecutionValues values;
+    values.set(RequestId{10})
+          .set(QStringLiteral("!"));
+    QCOMPARE(values.get<RequestId>()->id, 10);
+
+    QCOMPARE(job.exec(1, values).value(), QStringLiteral("31!"));
+
+    // Values are replaced by type, the copies are independent
+    auto other = values;
+    other.set(RequestId{100});
+    QCOMPARE(job.exec(1, other).value(), QStringLiteral("301!"));
+    QCOMPARE(values.get<RequestId>()->id, 10);
+
+    // Without values, and outside of the continuations, there is nothing
+    QCOMPARE(KAsync::start<int>(requestId).exec().value(), -1);
+    QVERIFY(!KAsync::executionValue<RequestId>());
+
+    // Synchronous runs of a job inside a continuation do not see them either
+    auto inner = KAsync::start<int>(requestId);
+    auto outer = KAsync::start<int>([&] {
+            return inner.execSync().value();
+        });
+    QCOMPARE(outer.exec(values).value(), -1);
+
+    // So do the bodies of forEach(), serialForEach() and doWhile()
+    QVector<int> seen;
+    auto collect = KAsync::start<void, int>([&](int i) {
+        seen << i + requestId();
+    });
+    KAsync::forEach<QVector<int>>(collect).exec(QVector<int>{1, 2}, values).waitForFinished();
+    KAsync::serialForEach<QVector<int>>(collect).exec(QVector<int>{3}, values).waitForFinished();
+    QCOMPARE(seen, (QVector<int>{11, 12, 13}));
+
+    int iterations = 0;
+    KAsync::doWhile(KAsync::start<KAsync::ControlFlowFlag>([&] {
+            seen << requestId();
+            return ++iterations < 2 ? KAsync::Continue : KAsync::Break;
+        }))
+        .exec(values)
+        .waitForFinished();
+    QCOMPARE(seen, (QVector<int>{11, 12, 13, 10, 10}));
+
+    // Prepared jobs see the values as well, also when run synchronously
+    auto prepared = job.prepare();
+    QCOMPARE(prepared.exec(1, values).value(), QStringLiteral("31!"));
+    auto preparedSync = KAsync::start<int, int>([&](int i) {
+            return i + requestId();
+        })
+        .prepare();
+    QCOMPARE(preparedSync.exec(1, values).value(), 11);
+    QCOMPARE(preparedSync.exec(1).value(), 0);
+    QCOMPARE(KAsync::start<int>(requestId).prepare().exec(values).value(), 10);
+}
+
+void AsyncTest::testConcurrentExec()
+{
+    using KAsync::Metrics;
+    using KAsync::TrackedObject;
+
+    auto job = KAsync::start<int, int>([](int i) {
+            return i * 2;
+        })
+        .then([](int i) {
+            return i + 1;
+        });
+
+    // The input is not passed through an executor of its own
+    const auto executors = Metrics::objectCount(TrackedObject::Executor).live;
+    Metrics::setEnabled(true);
+    Metrics::resetPeakObjectCounts();
+    QCOMPARE(job.exec(20).value(), 41);
+    QCOMPARE(Metrics::objectCount(TrackedObject::Executor).peak, executors);
+    Metrics::setEnabled(false);
+
+    // So one job can be executed from several threads at once
+    std::atomic<int> failures{0};
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&job, &failures, t] {
+            for (int i = 0; i < 1000; ++i) {
+                const int input = t * 1000 + i;
+                if (job.exec(input).value() != input * 2 + 1) {
+                    ++failures;
+                }
+            }
+        });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    QCOMPARE(failures.load(), 0);
+}
+
+void AsyncTest::testPreparedJob()
+{
+    using KAsync::Metrics;
+    using KAsync::TrackedObject;
+
+    // Synchronous jobs finish within exec(), without any execution
+    auto sync = KAsync::start<int, int>([](int i) {
+            return i + 1;
+        })
+        .then([](const KAsync::Error &error, int i) {
+            return error ? -1 : i * 2;
+        })
+        .prepare();
+    const auto executions = Metrics::objectCount(TrackedObject::Execution).live;
+    Metrics::setEnabled(true);
+    Metrics::resetPeakObjectCounts();
+    auto future = sync.exec(20);
+    QVERIFY(future.isFinished());
+    QCOMPARE(future.value(), 42);
+    QCOMPARE(Metrics::objectCount(TrackedObject::Execution).peak, executions);
+    Metrics::setEnabled(false);
+
+    // Others are run like with Job::exec(), also once the PreparedJob is gone
+    auto divide = KAsync::start<int, int>([](int i) -> KAsync::Job<int> {
+            return i ? KAsync::value(100 / i) : KAsync::error<int>(1, "division by zero");
+        });
+    auto prepared = std::make_unique<KAsync::PreparedJob<int, int>>(
+        divide.then<int, int>([](int i, KAsync::Future<int> &future) {
+            QTimer::singleShot(0, [i, &future] {
+                future.setValue(i + 1);
+                future.setFinished();
+            });
+        }).prepare());
+    auto first = prepared->exec(4);
+    auto second = prepared->exec(0);
+    prepared.reset();
+    first.waitForFinished();
+    second.waitForFinished();
+    QCOMPARE(first.value(), 26);
+    QCOMPARE(second.errorCode(), 1);
+    QCOMPARE(second.errorMessage(), QStringLiteral("division by zero"));
+}
+
+void AsyncTest::testWaitForCompletion()
+{
+    QVector<KAsync::Future<void>> futures(3);
+    futures[1].setFinished();
+
+    bool done = false;
+    auto future = KAsync::waitForCompletion(futures)
+        .then([&done] {
+            done = true;
+        })
+        .exec();
+    QVERIFY(!done);
+
+    // The futures may finish in any order
+    futures[2].setFinished();
+    QVERIFY(!done);
+    futures[0].setError(1, "failed");
+    QVERIFY(done);
+    QVERIFY(future.isFinished());
+    QVERIFY(!future.hasError());
+
+    // Nothing to wait for
+    futures[0] = KAsync::Future<void>();
+    futures[0].setFinished();
+    QVERIFY(KAsync::waitForCompletion(futures).exec().isFinished());
+
+    // The futures may be finished on another thread while they are joined
+    for (int i = 0; i < 100; ++i) {
+        const QVector<KAsync::Future<void>> pending(100);
+        std::atomic<bool> joined{false};
+        std::thread finisher([pending] {
+            for (KAsync::Future<void> f : pending) {
+                f.setFinished();
+            }
+        });
+        KAsync::Private::CompletionLatch::waitForAll(pending, [&joined] {
+            joined = true;
+        });
+        finisher.join();
+        QVERIFY(joined);
+    }
+}
+
+void AsyncTest::testWhenAll()
+{
+    QVector<KAsync::Future<QString>> futures(3);
+    futures[1].setValue(QStringLiteral("b"));
+    futures[1].setFinished();
+
+    auto future = KAsync::whenAll(futures).exec();
+    QVERIFY(!future.isFinished());
+    futures[2].setValue(QStringLiteral("c"));
+    futures[2].setFinished();
+    futures[0].setValue(QStringLiteral("a"));
+    futures[0].setFinished();
+    QVERIFY(future.isFinished());
+    QCOMPARE(future.value(), (QVector<QString>{"a", "b", "c"}));
+
+    // The values stay in the futures
+    QCOMPARE(futures[0].value(), QStringLiteral("a"));
+    QCOMPARE(KAsync::whenAll(futures).exec().value(), (QVector<QString>{"a", "b", "c"}));
+
+    // The first error in the order of the futures wins
+    QVector<KAsync::Future<int>> failing(3);
+    auto failed = KAsync::whenAll(failing).exec();
+    failing[2].setError(2, "second");
+    failing[0].setValue(1);
+    failing[0].setFinished();
+    failing[1].setError(1, "first");
+    QVERIFY(failed.isFinished());
+    QCOMPARE(failed.errorCode(), 1);
+    QCOMPARE(failed.errorMessage(), QStringLiteral("first"));
+
+    QVector<KAsync::Future<int>> settling(3);
+    auto settled = KAsync::whenAllSettled(settling).exec();
+    settling[2].setError(2, "second");
+    settling[0].setValue(1);
+    settling[0].setFinished();
+    settling[1].setError(1, "first");
+    QVERIFY(settled.isFinished());
+    QVERIFY(!settled.hasError());
+    const auto results = settled.value();
+    QCOMPARE(results.size(), 3);
+    QCOMPARE(results[0].value(), 1);
+    QCOMPARE(results[1].error().errorCode, 1);
+    QCOMPARE(results[2].error().errorMessage, QStringLiteral("second"));
+
+    // Both read the same futures without taking the values away
+    QVector<KAsync::Future<QString>> shared(2);
+    auto allSettled = KAsync::whenAllSettled(shared).exec();
+    auto all = KAsync::whenAll(shared).exec();
+    shared[0].setValue(QStringLiteral("x"));
+    shared[0].setFinished();
+    shared[1].setValue(QStringLiteral("y"));
+    shared[1].setFinished();
+    QCOMPARE(allSettled.value()[0].value(), QStringLiteral("x"));
+    QCOMPARE(allSettled.value()[1].value(), QStringLiteral("y"));
+    QCOMPARE(all.value(), (QVector<QString>{"x", "y"}));
+    QCOMPARE(shared[1].value(), QStringLiteral("y"));
+}
+
+void AsyncTest::testParallel()
+{
+    bool secondStarted = false;
+    bool secondStartedFirst = false;
+    auto first = KAsync::start<int>([&](KAsync::Future<int> &future) {
+            QTimer::singleShot(0, [&] {
+                secondStartedFirst = secondStarted;
+                future.setValue(42);
+                future.setFinished();
+            });
+        });
+    auto second = KAsync::start<QString>([&] {
+            secondStarted = true;
+            return QStringLiteral("value");
+        });
+
+    auto future = KAsync::parallel(first, second).exec();
+    QVERIFY(secondStarted);
+    future.waitForFinished();
+    QVERIFY(secondStartedFirst);
+    QVERIFY(!future.hasError());
+    QCOMPARE(std::get<0>(future.value()), 42);
+    QCOMPARE(std::get<1>(future.value()), QStringLiteral("value"));
+
+    // The first failing job in the argument order wins
+    auto failed = KAsync::parallel(KAsync::error<int>(1, "first"), second, KAsync::error<double>(2, "second")).exec();
+    QVERIFY(failed.isFinished());
+    QCOMPARE(failed.errorCode(), 1);
+    QCOMPARE(failed.errorMessage(), QStringLiteral("first"));
+
+    // The branches see the values of the execution
+    KAsync::ExecutionValues values;
+    values.set(QStringLiteral("value"));
+    auto valueOf = KAsync::start<QString>([] {
+            return *KAsync::executionValue<QString>();
+        });
+    QCOMPARE(std::get<0>(KAsync::parallel(valueOf, valueOf).exec(values).value()), QStringLiteral("value"));
+
+    // And are cancelled with it when a guard is destroyed
+    KAsync::VirtualTimerSource timers(false);
+    KAsync::TimerSource::setInstance(&timers);
+    bool run = false;
+    auto branch = KAsync::wait(1000).then([&run] {
+            run = true;
+            return 1;
+        });
+    auto guard = new QObject;
+    auto cancelled = KAsync::parallel(branch, branch).guard(guard).exec();
+    QCOMPARE(timers.pendingTimers(), 2);
+    delete guard;
+    QVERIFY(cancelled.isFinished());
+    QCOMPARE(timers.pendingTimers(), 0);
+    timers.advance(1000);
+    QVERIFY(!run);
+    KAsync::TimerSource::setInstance(nullptr);
+}
+
 QTEST_MAIN(AsyncTest)
 
 #include "asynctest.moc"
@@ -0,0 +1,580 @@
+/*
+    SPDX-FileCopyrightText: 2026 KAsync contributors
+
+    SPDX-License-Identifier: GPL-2.0-only OR GPL-3.0-only OR LicenseRef-KDE-Accepted-GPL
+*/
+
+// Krazy mistakes job.exec() for QDialog::exec() and urges us to use QPointer
+//krazy:excludeall=crashy
+
+#include "../src/async.h"
+#include "perfcounters.h"
+
+#include <QDebug>
+#include <QEventLoop>
+#include <QFuture>
+#include <QFutureInterface>
+#include <QFutureWatcher>
+#include <QObject>
+#include <QTimer>
+#include <QtTest/QTest>
+
+#include <functional>
+#include <memory>
+#include <numeric>
+#include <vector>
+
+/**
+ * Benchmarks of the execution engine.
+ *
+ * Most benchmarks are data driven, run a single one with i.e.
+ *   kasync_benchmarks benchmarkChain:deferred/1000
+ *
+ * The baseline* benchmarks implement the same work without KAsync, so that
+ * the overhead of the library can be put into relation.
+ *
+ * If the KASYNC_PERF_COUNTERS environment variable is set, each benchmark
+ * additionally reports hardware performance counters per continuation step
+ * (Linux only).
+ */
+class AsyncBenchmark : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum Completion {
+        Sync,       // SyncContinuation
+        Immediate,  // AsyncContinuation finishing the future right away
+        Deferred    // AsyncContinuation finishing the future from the event loop
+    };
+
+private Q_SLOTS:
+    void benchmarkSyncThenExecutor();
+    void benchmarkFutureThenExecutor();
+    void benchmarkThenExecutor();
+
+    void benchmarkChain_data();
+    void benchmarkChain();
+    void benchmarkExecSync_data();
+    void benchmarkExecSync();
+    void benchmarkChainCreation_data();
+    void benchmarkChainCreation();
+    void benchmarkForEach_data();
+    void benchmarkForEach();
+    void benchmarkNestedJobs_data();
+    void benchmarkNestedJobs();
+    void benchmarkDoWhile_data();
+    void benchmarkDoWhile();
+    void benchmarkPayload_data();
+    void benchmarkPayload();
+
+    void baselineLambdaChain_data();
+    void baselineLambdaChain();
+    void baselineTimerChain_data();
+    void baselineTimerChain();
+    void baselineQFutureChain_data();
+    void baselineQFutureChain();
+
+private:
+    static void addChainRows(const QVector<int> &completions);
+    static KAsync::Job<int> appendStep(const KAsync::Job<int> &job, int completion);
+    static KAsync::Job<int> createChain(int length, int completion);
+    static KAsync::Job<int> nestedJob(int depth);
+};
+
+static const char *completionName(int completion)
+{
+    switch (completion) {
+    case AsyncBenchmark::Sync:
+        return "sync";
+    case AsyncBenchmark::Immediate:
+        return "immediate";
+    case AsyncBenchmark::Deferred:
+        return "deferred";
+    }
+    return "";
+}
+
+/**
+ * Runs @p iteration repeatedly with hardware performance counters enabled
+ * and prints the average counts per step, if requested.
+ */
+template<typename F>
+static void reportPerfCounters(int steps, F &&iteration)
+{
+    static const bool enabled = qEnvironmentVariableIsSet("KASYNC_PERF_COUNTERS");
+    if (!enabled) {
+        return;
+    }
+    PerfCounters counters;
+    if (!counters.isAvailable()) {
+        static bool warned = false;
+        if (!warned) {
+            qWarning() << "Hardware performance counters are not available";
+            warned = true;
+        }
+        return;
+    }
+
+    const int iterations = 100;
+    for (int i = 0; i < iterations; ++i) {
+        counters.start();
+        iteration();
+        counters.stop();
+    }
+
+    QByteArray report("Per step:");
+    for (int i = 0; i < PerfCounters::CounterCount; ++i) {
+        const auto counter = static_cast<PerfCounters::Counter>(i);
+        report += QByteArray(" ") + PerfCounters::name(counter) + '='
+                  + QByteArray::number(double(counters.value(counter)) / (iterations * qMax(steps, 1)), 'f', 1);
+    }
+    qDebug().noquote() << report;
+}
+
+void AsyncBenchmark::addChainRows(const QVector<int> &completions)
+{
+    QTest::addColumn<int>("length");
+    QTest::addColumn<int>("completion");
+
+    for (int completion : completions) {
+        for (int length : {1, 10, 100, 1000, 10000}) {
+            const QByteArray tag = QByteArray(completionName(completion)) + '/' + QByteArray::number(length);
+            QTest::newRow(tag.constData()) << length << completion;
+        }
+    }
+}
+
+KAsync::Job<int> AsyncBenchmark::appendStep(const KAsync::Job<int> &job, int completion)
+{
+    switch (completion) {
+    case Immediate:
+        return job.then<int, int>([](int i, KAsync::Future<int> &future) {
+            future.setValue(i + 1);
+            future.setFinished();
+        });
+    case Deferred:
+        return job.then<int, int>([](int i, KAsync::Future<int> &future) {
+            QTimer::singleShot(0, [i, &future]() {
+                future.setValue(i + 1);
+                future.setFinished();
+            });
+        });
+    default:
+        return job.then<int, int>([](int i) {
+            return i + 1;
+        });
+    }
+}
+
+KAsync::Job<int> AsyncBenchmark::createChain(int length, int completion)
+{
+    auto job = KAsync::start<int>([]() {
+        return 0;
+    });
+    for (int i = 1; i < length; ++i) {
+        job = appendStep(job, completion);
+    }
+    return job;
+}
+
+KAsync::Job<int> AsyncBenchmark::nestedJob(int depth)
+{
+    if (depth == 0) {
+        return KAsync::value(0);
+    }
+    return KAsync::start<int>([depth]() {
+        return nestedJob(depth - 1);
+    });
+}
+
+void AsyncBenchmark::benchmarkSyncThenExecutor()
+{
+    auto job = KAsync::start<int>(
+        []() {
+            return 1;
+        });
+
+    QBENCHMARK {
+       job.exec();
+    }
+    reportPerfCounters(1, [&job]() {
+        job.exec();
+    });
+}
+
+void AsyncBenchmark::benchmarkFutureThenExecutor()
+{
+    auto job = KAsync::start<int>(
+        [](KAsync::Future<int> &f) {
+            f.setResult(1);
+        });
+
+    QBENCHMARK {
+       job.exec();
+    }
+    reportPerfCounters(1, [&job]() {
+        job.exec();
+    });
+}
+
+void AsyncBenchmark::benchmarkThenExecutor()
+{
+    //This is exactly the same as the future version (due to it's implementation).
+    auto job = KAsync::value(1);
+
+    QBENCHMARK {
+       job.exec();
+    }
+    reportPerfCounters(1, [&job]() {
+        job.exec();
+    });
+}
+
+void AsyncBenchmark::benchmarkChain_data()
+{
+    addChainRows({Sync, Immediate, Deferred});
+}
+
+void AsyncBenchmark::benchmarkChain()
+{
+    QFETCH(int, length);
+    QFETCH(int, completion);
+
+    auto job = createChain(length, completion);
+    auto future = job.exec();
+    future.waitForFinished();
+    QCOMPARE(future.value(), length - 1);
+
+    QBENCHMARK {
+        job.exec().waitForFinished();
+    }
+    reportPerfCounters(length, [&job]() {
+        job.exec().waitForFinished();
+    });
+}
+
+void AsyncBenchmark::benchmarkExecSync_data()
+{
+    addChainRows({Sync});
+}
+
+void AsyncBenchmark::benchmarkExecSync()
+{
+    QFETCH(int, length);
+    QFETCH(int, completion);
+
+    auto job = createChain(length, completion);
+    QCOMPARE(job.execSync().value(), length - 1);
+
+    QBENCHMARK {
+        job.execSync();
+    }
+    reportPerfCounters(length, [&job]() {
+        job.execSync();
+    });
+}
+
+void AsyncBenchmark::benchmarkChainCreation_data()
+{
+    addChainRows({Sync});
+}
+
+void AsyncBenchmark::benchmarkChainCreation()
+{
+    QFETCH(int, length);
+    QFETCH(int, completion);
+
+    QBENCHMARK {
+        auto job = createChain(length, completion);
+        Q_UNUSED(job);
+    }
+    reportPerfCounters(length, [length, completion]() {
+        auto job = createChain(length, completion);
+        Q_UNUSED(job);
+    });
+}
+
+void AsyncBenchmark::benchmarkForEach_data()
+{
+    QTest::addColumn<int>("width");
+    QTest::addColumn<bool>("serial");
+    QTest::addColumn<int>("completion");
+
+    for (bool serial : {false, true}) {
+        for (int completion : {Sync, Deferred}) {
+            for (int width : {1, 10, 100, 1000}) {
+                const QByteArray tag = QByteArray(serial ? "serial/" : "parallel/") + completionName(completion)
+                                       + '/' + QByteArray::number(width);
+                QTest::newRow(tag.constData()) << width << serial << completion;
+            }
+        }
+    }
+}
+
+void AsyncBenchmark::benchmarkForEach()
+{
+    QFETCH(int, width);
+    QFETCH(bool, serial);
+    QFETCH(int, completion);
+
+    QVector<int> list(width);
+    std::iota(list.begin(), list.end(), 0);
+
+    int count = 0;
+    const auto element = completion == Deferred
+        ? KAsync::start<void, int>([&count](int, KAsync::Future<void> &future) {
+              QTimer::singleShot(0, [&count, &future]() {
+                  ++count;
+                  future.setFinished();
+              });
+          })
+        : KAsync::start<void, int>([&count](int) {
+              ++count;
+          });
+    auto job = serial ? KAsync::serialForEach<QVector<int>>(element)
+                            : KAsync::forEach<QVector<int>>(element);
+    job.exec(list).waitForFinished();
+    QCOMPARE(count, width);
+
+    QBENCHMARK {
+        job.exec(list).waitForFinished();
+    }
+    reportPerfCounters(width, [&job, &list]() {
+        job.exec(list).waitForFinished();
+    });
+}
+
+void AsyncBenchmark::benchmarkNestedJobs_data()
+{
+    QTest::addColumn<int>("depth");
+
+    for (int depth : {1, 10, 100}) {
+        QTest::newRow(QByteArray::number(depth).constData()) << depth;
+    }
+}
+
+void AsyncBenchmark::benchmarkNestedJobs()
+{
+    QFETCH(int, depth);
+
+    auto job = nestedJob(depth);
+    QVERIFY(job.exec().isFinished());
+
+    QBENCHMARK {
+        job.exec();
+    }
+    reportPerfCounters(depth + 1, [&job]() {
+        job.exec();
+    });
+}
+
+void AsyncBenchmark::benchmarkDoWhile_data()
+{
+    QTest::addColumn<int>("iterations");
+    QTest::addColumn<int>("completion");
+
+    for (int completion : {Sync, Deferred}) {
+        for (int iterations : {1, 10, 100, 1000}) {
+            const QByteArray tag = QByteArray(completionName(completion)) + '/' + QByteArray::number(iterations);
+            QTest::newRow(tag.constData()) << iterations << completion;
+        }
+    }
+}
+
+void AsyncBenchmark::benchmarkDoWhile()
+{
+    QFETCH(int, iterations);
+    QFETCH(int, completion);
+
+    int count = 0;
+    const auto next = [&count, iterations]() {
+        return ++count < iterations ? KAsync::Continue : KAsync::Break;
+    };
+    const auto body = completion == Deferred
+        ? KAsync::start<KAsync::ControlFlowFlag>([next](KAsync::Future<KAsync::ControlFlowFlag> &future) {
+              QTimer::singleShot(0, [next, &future]() {
+                  future.setValue(next());
+                  future.setFinished();
+              });
+          })
+        : KAsync::start<KAsync::ControlFlowFlag>(next);
+    auto job = KAsync::doWhile(body);
+    job.exec().waitForFinished();
+    QCOMPARE(count, iterations);
+
+    QBENCHMARK {
+        count = 0;
+        job.exec().waitForFinished();
+    }
+    reportPerfCounters(iterations, [&job, &count]() {
+        count = 0;
+        job.exec().waitForFinished();
+    });
+}
+
+void AsyncBenchmark::benchmarkPayload_data()
+{
+    QTest::addColumn<int>("size");
+    QTest::addColumn<bool>("shared");
+
+    for (bool shared : {false, true}) {
+        for (int size : {0, 1024, 1024 * 1024}) {
+            const QByteArray tag = QByteArray(shared ? "QByteArray/" : "std::vector/") + QByteArray::number(size);
+            QTest::newRow(tag.constData()) << size << shared;
+        }
+    }
+}
+
+template<typename Payload>
+static void runPayloadBenchmark(int size)
+{
+    // Every step takes and returns the payload by value
+    auto job = KAsync::start<Payload>([size]() {
+        return Payload(size, 'x');
+    });
+    for (int i = 0; i < 10; ++i) {
+        job = job.template then<Payload, Payload>([](Payload payload) {
+            return payload;
+        });
+    }
+    QCOMPARE(static_cast<int>(job.exec().value().size()), size);
+
+    QBENCHMARK {
+        job.exec();
+    }
+    reportPerfCounters(11, [&job]() {
+        job.exec();
+    });
+}
+
+void AsyncBenchmark::benchmarkPayload()
+{
+    QFETCH(int, size);
+    QFETCH(bool, shared);
+
+    if (shared) {
+        runPayloadBenchmark<QByteArray>(size);
+    } else {
+        runPayloadBenchmark<std::vector<char>>(size);
+    }
+}
+
+void AsyncBenchmark::baselineLambdaChain_data()
+{
+    addChainRows({Sync});
+}
+
+void AsyncBenchmark::baselineLambdaChain()
+{
+    QFETCH(int, length);
+
+    std::vector<std::function<int(int)>> chain(length, [](int i) {
+        return i + 1;
+    });
+
+    int result = 0;
+    QBENCHMARK {
+        result = 0;
+        for (const auto &step : chain) {
+            result = step(result);
+        }
+    }
+    reportPerfCounters(length, [&chain, &result]() {
+        result = 0;
+        for (const auto &step : chain) {
+            result = step(result);
+        }
+    });
+    QCOMPARE(result, length);
+}
+
+void AsyncBenchmark::baselineTimerChain_data()
+{
+    addChainRows({Deferred});
+}
+
+static int runTimerChain(int length)
+{
+    int result = 0;
+    QEventLoop loop;
+    std::function<void()> step;
+    step = [&]() {
+        if (++result < length) {
+            QTimer::singleShot(0, step);
+        } else {
+            loop.quit();
+        }
+    };
+    QTimer::singleShot(0, step);
+    loop.exec();
+    return result;
+}
+
+void AsyncBenchmark::baselineTimerChain()
+{
+    QFETCH(int, length);
+
+    QCOMPARE(runTimerChain(length), length);
+
+    QBENCHMARK {
+        runTimerChain(length);
+    }
+    reportPerfCounters(length, [length]() {
+        runTimerChain(length);
+    });
+}
+
+void AsyncBenchmark::baselineQFutureChain_data()
+{
+    addChainRows({Deferred});
+}
+
+static int runQFutureChain(int length)
+{
+    // Like a KAsync chain, each step watches the future of its predecessor
+    QEventLoop loop;
+    std::vector<std::unique_ptr<QFutureWatcher<int>>> watchers;
+    watchers.reserve(length);
+    QFutureInterface<int> first;
+    first.reportStarted();
+    QFuture<int> previous = first.future();
+    for (int i = 0; i < length; ++i) {
+        auto next = std::make_shared<QFutureInterface<int>>();
+        next->reportStarted();
+        watchers.push_back(std::make_unique<QFutureWatcher<int>>());
+        auto watcher = watchers.back().get();
+        QObject::connect(watcher, &QFutureWatcher<int>::finished, [watcher, next]() {
+            const int value = watcher->result() + 1;
+            next->reportFinished(&value);
+        });
+        watcher->setFuture(previous);
+        previous = next->future();
+    }
+    auto last = std::make_unique<QFutureWatcher<int>>();
+    QObject::connect(last.get(), &QFutureWatcher<int>::finished, &loop, &QEventLoop::quit);
+    last->setFuture(previous);
+
+    const int initial = 0;
+    first.reportFinished(&initial);
+    loop.exec();
+    return previous.result();
+}
+
+void AsyncBenchmark::baselineQFutureChain()
+{
+    QFETCH(int, length);
+
+    QCOMPARE(runQFutureChain(length), length);
+
+    QBENCHMARK {
+        runQFutureChain(length);
+    }
+    reportPerfCounters(length, [length]() {
+        runQFutureChain(length);
+    });
+}
+
+QTEST_MAIN(AsyncBenchmark)
+
+#include "asyncbenchmark.moc"
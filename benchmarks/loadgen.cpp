@@ -0,0 +1,461 @@
+/*
+    SPDX-FileCopyrightText: 2026 KAsync contributors
+
+    SPDX-License-Identifier: GPL-2.0-only OR GPL-3.0-only OR LicenseRef-KDE-Accepted-GPL
+*/
+
+// Krazy mistakes job.exec() for QDialog::exec() and urges us to use QPointer
+//krazy:excludeall=crashy
+
+#include "../src/async.h"
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QPointer>
+#include <QTimer>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#if defined(Q_OS_LINUX)
+#include <unistd.h>
+#elif defined(Q_OS_UNIX)
+#include <sys/resource.h>
+#endif
+
+/*
+ * Keeps a configurable number of randomized job chains in flight and reports
+ * the throughput, the completion latency percentiles and the resident memory.
+ *
+ * The chains mix calls to a simulated asynchronous backend with random
+ * latency and failures, wait(), nested jobs, forEach(), error handlers and
+ * guards that are deleted while the chain is running.
+ */
+
+namespace {
+
+/**
+ * Log-linear histogram in the spirit of HdrHistogram: values are recorded
+ * with a relative error below 1 / 2^subBucketBits over the full 64 bit range.
+ */
+class LatencyHistogram
+{
+public:
+    explicit LatencyHistogram(int subBucketBits = 7)
+        : mSubBucketBits(subBucketBits)
+        , mSubBucketCount(1 << subBucketBits)
+        , mCounts(2 * mSubBucketCount + (63 - subBucketBits) * mSubBucketCount, 0)
+    {
+    }
+
+    void record(qint64 value)
+    {
+        value = std::max<qint64>(value, 0);
+        ++mCounts[index(value)];
+        ++mTotal;
+        mMax = std::max(mMax, value);
+    }
+
+    void add(const LatencyHistogram &other)
+    {
+        for (size_t i = 0; i < mCounts.size(); ++i) {
+            mCounts[i] += other.mCounts[i];
+        }
+        mTotal += other.mTotal;
+        mMax = std::max(mMax, other.mMax);
+    }
+
+    void reset()
+    {
+        std::fill(mCounts.begin(), mCounts.end(), 0);
+        mTotal = 0;
+        mMax = 0;
+    }
+
+    quint64 count() const
+    {
+        return mTotal;
+    }
+
+    qint64 max() const
+    {
+        return mMax;
+    }
+
+    /**
+     * Returns the highest value equivalent to the given percentile (0 - 100).
+     */
+    qint64 percentile(double percentile) const
+    {
+        if (!mTotal) {
+            return 0;
+        }
+        const auto target = std::max<quint64>(1, static_cast<quint64>(std::ceil(percentile / 100.0 * mTotal)));
+        quint64 seen = 0;
+        for (size_t i = 0; i < mCounts.size(); ++i) {
+            seen += mCounts[i];
+            if (seen >= target) {
+                return std::min(highestEquivalentValue(static_cast<int>(i)), mMax);
+            }
+        }
+        return mMax;
+    }
+
+private:
+    int index(qint64 value) const
+    {
+        // Values below 2 * mSubBucketCount are exact, above that every power
+        // of two is split into mSubBucketCount linear sub buckets.
+        if (value < 2 * mSubBucketCount) {
+            return static_cast<int>(value);
+        }
+        int msb = 63;
+        while (!(value >> msb)) {
+            --msb;
+        }
+        const int shift = msb - mSubBucketBits;
+        return 2 * mSubBucketCount + (shift - 1) * mSubBucketCount
+               + static_cast<int>((value >> shift) - mSubBucketCount);
+    }
+
+    qint64 highestEquivalentValue(int index) const
+    {
+        if (index < 2 * mSubBucketCount) {
+            return index;
+        }
+        const int shift = (index - 2 * mSubBucketCount) / mSubBucketCount + 1;
+        const qint64 subBucket = (index - 2 * mSubBucketCount) % mSubBucketCount + mSubBucketCount;
+        return ((subBucket + 1) << shift) - 1;
+    }
+
+    const int mSubBucketBits;
+    const int mSubBucketCount;
+    std::vector<quint64> mCounts;
+    quint64 mTotal = 0;
+    qint64 mMax = 0;
+};
+
+/**
+ * Resident set size of the process in bytes, or the peak resident set size
+ * where the current one is not available. Returns 0 if neither is.
+ */
+qint64 residentSetSize()
+{
+#if defined(Q_OS_LINUX)
+    long pages = 0;
+    if (FILE *statm = std::fopen("/proc/self/statm", "r")) {
+        long size = 0;
+        if (std::fscanf(statm, "%ld %ld", &size, &pages) != 2) {
+            pages = 0;
+        }
+        std::fclose(statm);
+    }
+    return static_cast<qint64>(pages) * sysconf(_SC_PAGESIZE);
+#elif defined(Q_OS_UNIX)
+    rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+#if defined(Q_OS_MACOS)
+    return usage.ru_maxrss;
+#else
+    return static_cast<qint64>(usage.ru_maxrss) * 1024;
+#endif
+#else
+    return 0;
+#endif
+}
+
+/**
+ * Simulated asynchronous backend, completing requests from the event loop
+ * after a random latency.
+ */
+class Backend
+{
+public:
+    Backend(std::mt19937 &random, double meanLatency, double errorRate)
+        : mRandom(random)
+        , mLatency(1.0 / meanLatency)
+        , mErrorRate(errorRate)
+    {
+    }
+
+    template<typename T>
+    KAsync::Job<T> request(T value)
+    {
+        return KAsync::start<T>([this, value](KAsync::Future<T> &future) {
+            const bool fail = failure();
+            QTimer::singleShot(latency(), [&future, value, fail]() {
+                if (fail) {
+                    future.setError(1, QStringLiteral("Backend failure"));
+                } else {
+                    future.setValue(value);
+                    future.setFinished();
+                }
+            });
+        });
+    }
+
+    KAsync::Job<void, int> notify()
+    {
+        return KAsync::start<void, int>([this](int, KAsync::Future<void> &future) {
+            QTimer::singleShot(latency(), [&future]() {
+                future.setFinished();
+            });
+        });
+    }
+
+private:
+    int latency()
+    {
+        // Mostly exponential, with a slow tail of one in a thousand requests
+        if (std::uniform_int_distribution<int>(0, 999)(mRandom) == 0) {
+            return 200;
+        }
+        return static_cast<int>(mLatency(mRandom));
+    }
+
+    bool failure()
+    {
+        return std::uniform_real_distribution<double>(0, 1)(mRandom) < mErrorRate;
+    }
+
+    std::mt19937 &mRandom;
+    std::exponential_distribution<double> mLatency;
+    double mErrorRate;
+};
+
+class LoadGenerator
+{
+public:
+    LoadGenerator(int concurrency, double meanLatency, double errorRate, double guardRate, unsigned seed)
+        : mConcurrency(concurrency)
+        , mGuardRate(guardRate)
+        , mRandom(seed)
+        , mBackend(mRandom, meanLatency, errorRate)
+    {
+    }
+
+    void start(int durationSecs, int intervalSecs)
+    {
+        mTime.start();
+        mIntervalTime.start();
+        mPeakRss = residentSetSize();
+
+        QObject::connect(&mReportTimer, &QTimer::timeout, [this]() {
+            report();
+        });
+        mReportTimer.start(intervalSecs * 1000);
+        QTimer::singleShot(durationSecs * 1000, [this]() {
+            finish();
+        });
+
+        std::printf("%8s %10s %10s %10s %10s %10s %10s %12s %10s\n", "time[s]", "done/s", "errors", "cancelled",
+                    "p50[ms]", "p99[ms]", "p999[ms]", "executions", "rss[MB]");
+        for (int i = 0; i < mConcurrency; ++i) {
+            startChain();
+        }
+    }
+
+private:
+    int random(int min, int max)
+    {
+        return std::uniform_int_distribution<int>(min, max)(mRandom);
+    }
+
+    KAsync::Job<int> createChain()
+    {
+        auto job = mBackend.request(0);
+        const int steps = random(1, 8);
+        for (int i = 0; i < steps; ++i) {
+            switch (random(0, 5)) {
+            case 0:
+                job = job.then([](int value) {
+                    return value + 1;
+                });
+                break;
+            case 1:
+                job = job.then([this](int value) {
+                    return mBackend.request(value + 1);
+                });
+                break;
+            case 2: {
+                const int delay = random(0, 10);
+                job = job.then([delay](int value) {
+                    return KAsync::wait(delay).then([value]() {
+                        return value;
+                    });
+                });
+                break;
+            }
+            case 3: {
+                const int width = random(1, 16);
+                job = job.then([this, width](int value) {
+                    return KAsync::value(QVector<int>(width, value))
+                        .then(KAsync::forEach<QVector<int>>(mBackend.notify()))
+                        .then([value]() {
+                            return value;
+                        });
+                });
+                break;
+            }
+            case 4:
+                job = job.then([this](int value) {
+                    return createNestedChain(value, random(1, 3));
+                });
+                break;
+            default:
+                // Recover from errors of previous steps
+                job = job.then([](const KAsync::Error &error, int value) {
+                    return error ? -1 : value;
+                });
+                break;
+            }
+        }
+        return job;
+    }
+
+    KAsync::Job<int> createNestedChain(int value, int depth)
+    {
+        if (depth == 0) {
+            return mBackend.request(value);
+        }
+        return mBackend.request(value).then([this, depth](int value) {
+            return createNestedChain(value + 1, depth - 1);
+        });
+    }
+
+    void startChain()
+    {
+        auto job = createChain();
+        QPointer<QObject> guard;
+        if (std::uniform_real_distribution<double>(0, 1)(mRandom) < mGuardRate) {
+            guard = new QObject;
+            job.guard(guard);
+            // The guard usually goes away after the chain has finished
+            QTimer::singleShot(random(1, 100), guard.data(), [guard]() {
+                delete guard.data();
+            });
+        }
+
+        QElapsedTimer started;
+        started.start();
+        const bool guarded = guard;
+        auto watcher = new KAsync::FutureWatcher<int>();
+        QObject::connect(watcher, &KAsync::FutureWatcher<int>::futureReady, [this, watcher, started, guard, guarded]() {
+            mInterval.record(started.nsecsElapsed());
+            if (watcher->future().hasError()) {
+                ++mErrors;
+            } else if (guarded && !guard) {
+                ++mCancelled;
+            }
+            delete guard.data();
+            watcher->deleteLater();
+            if (!mFinished) {
+                startChain();
+            }
+        });
+        watcher->setFuture(job.exec());
+    }
+
+    void report()
+    {
+        const double elapsed = mIntervalTime.restart() / 1000.0;
+        const qint64 rss = residentSetSize();
+        mPeakRss = std::max(mPeakRss, rss);
+        std::printf("%8.1f %10.0f %10llu %10llu %10.2f %10.2f %10.2f %12lld %10.1f\n", mTime.elapsed() / 1000.0,
+                    mInterval.count() / elapsed, mErrors, mCancelled, mInterval.percentile(50) / 1e6,
+                    mInterval.percentile(99) / 1e6, mInterval.percentile(99.9) / 1e6,
+                    KAsync::Metrics::objectCount(KAsync::TrackedObject::Execution).live, rss / 1048576.0);
+        std::fflush(stdout);
+        mTotal.add(mInterval);
+        mInterval.reset();
+        mTotalErrors += mErrors;
+        mTotalCancelled += mCancelled;
+        mErrors = 0;
+        mCancelled = 0;
+    }
+
+    void finish()
+    {
+        report();
+        mFinished = true;
+        mReportTimer.stop();
+
+        std::printf("\ncompleted %llu chains in %.1f s (%.0f/s), %llu errors, %llu cancelled by guards\n",
+                    mTotal.count(), mTime.elapsed() / 1000.0, mTotal.count() / (mTime.elapsed() / 1000.0),
+                    mTotalErrors, mTotalCancelled);
+        std::printf("latency [ms]: p50 %.2f  p90 %.2f  p99 %.2f  p99.9 %.2f  max %.2f\n",
+                    mTotal.percentile(50) / 1e6, mTotal.percentile(90) / 1e6, mTotal.percentile(99) / 1e6,
+                    mTotal.percentile(99.9) / 1e6, mTotal.max() / 1e6);
+        std::printf("peak rss: %.1f MB\n", mPeakRss / 1048576.0);
+        std::fflush(stdout);
+        QCoreApplication::quit();
+    }
+
+    const int mConcurrency;
+    const double mGuardRate;
+    std::mt19937 mRandom;
+    Backend mBackend;
+
+    QTimer mReportTimer;
+    QElapsedTimer mTime;
+    QElapsedTimer mIntervalTime;
+    LatencyHistogram mInterval;
+    LatencyHistogram mTotal;
+    unsigned long long mErrors = 0;
+    unsigned long long mCancelled = 0;
+    unsigned long long mTotalErrors = 0;
+    unsigned long long mTotalCancelled = 0;
+    qint64 mPeakRss = 0;
+    bool mFinished = false;
+};
+
+}
+
+int main(int argc, char **argv)
+{
+    QCoreApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QStringLiteral("Runs randomized KAsync job chains under load."));
+    parser.addHelpOption();
+    const QCommandLineOption concurrency(QStringList{QStringLiteral("c"), QStringLiteral("concurrency")},
+                                         QStringLiteral("Number of chains kept in flight."),
+                                         QStringLiteral("chains"), QStringLiteral("2000"));
+    const QCommandLineOption duration(QStringList{QStringLiteral("d"), QStringLiteral("duration")},
+                                      QStringLiteral("Duration of the run in seconds."),
+                                      QStringLiteral("seconds"), QStringLiteral("10"));
+    const QCommandLineOption interval(QStringList{QStringLiteral("i"), QStringLiteral("interval")},
+                                      QStringLiteral("Reporting interval in seconds."),
+                                      QStringLiteral("seconds"), QStringLiteral("1"));
+    const QCommandLineOption latency(QStringLiteral("latency"),
+                                     QStringLiteral("Mean latency of the simulated backend in milliseconds."),
+                                     QStringLiteral("msecs"), QStringLiteral("5"));
+    const QCommandLineOption errors(QStringLiteral("error-rate"),
+                                    QStringLiteral("Probability of a failing backend request."),
+                                    QStringLiteral("rate"), QStringLiteral("0.01"));
+    const QCommandLineOption guards(QStringLiteral("guard-rate"),
+                                    QStringLiteral("Probability of a chain being guarded by a short-lived object."),
+                                    QStringLiteral("rate"), QStringLiteral("0.1"));
+    const QCommandLineOption seed(QStringLiteral("seed"), QStringLiteral("Seed of the random generator."),
+                                  QStringLiteral("seed"), QStringLiteral("1"));
+    parser.addOption(concurrency);
+    parser.addOption(duration);
+    parser.addOption(interval);
+    parser.addOption(latency);
+    parser.addOption(errors);
+    parser.addOption(guards);
+    parser.addOption(seed);
+    parser.process(app);
+
+    LoadGenerator generator(parser.value(concurrency).toInt(), parser.value(latency).toDouble(),
+                            parser.value(errors).toDouble(), parser.value(guards).toDouble(),
+                            parser.value(seed).toUInt());
+    generator.start(parser.value(duration).toInt(), std::max(1, parser.value(interval).toInt()));
+    return app.exec();
+}
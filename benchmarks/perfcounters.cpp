@@ -0,0 +1,126 @@
+/*
+    SPDX-FileCopyrightText: 2026 KAsync contributors
+
+    SPDX-License-Identifier: GPL-2.0-only OR GPL-3.0-only OR LicenseRef-KDE-Accepted-GPL
+*/
+
+#include "perfcounters.h"
+
+#ifdef Q_OS_LINUX
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cstring>
+#endif
+
+#ifdef Q_OS_LINUX
+static int openCounter(PerfCounters::Counter counter, int groupFd)
+{
+    static const quint64 configs[PerfCounters::CounterCount] = {
+        PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_CPU_CYCLES,
+        PERF_COUNT_HW_CACHE_MISSES,
+        PERF_COUNT_HW_BRANCH_MISSES
+    };
+
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = configs[counter];
+    attr.disabled = groupFd == -1; // the group is enabled through its leader
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP;
+    return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, groupFd, 0));
+}
+#endif
+
+PerfCounters::PerfCounters()
+{
+    for (int i = 0; i < CounterCount; ++i) {
+        mFds[i] = -1;
+        mValues[i] = 0;
+    }
+#ifdef Q_OS_LINUX
+    // All counters form one group, so that they are scheduled together
+    for (int i = 0; i < CounterCount; ++i) {
+        mFds[i] = openCounter(static_cast<Counter>(i), mFds[0]);
+        if (mFds[i] < 0) {
+            for (int j = 0; j < i; ++j) {
+                close(mFds[j]);
+                mFds[j] = -1;
+            }
+            break;
+        }
+    }
+#endif
+}
+
+PerfCounters::~PerfCounters()
+{
+#ifdef Q_OS_LINUX
+    for (int fd : mFds) {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+#endif
+}
+
+bool PerfCounters::isAvailable() const
+{
+    return mFds[0] >= 0;
+}
+
+void PerfCounters::start()
+{
+#ifdef Q_OS_LINUX
+    if (isAvailable()) {
+        ioctl(mFds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(mFds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+#endif
+}
+
+void PerfCounters::stop()
+{
+#ifdef Q_OS_LINUX
+    if (!isAvailable()) {
+        return;
+    }
+    ioctl(mFds[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+
+    // PERF_FORMAT_GROUP: the number of counters followed by their values
+    quint64 data[CounterCount + 1];
+    if (read(mFds[0], data, sizeof(data)) == static_cast<ssize_t>(sizeof(data)) && data[0] == CounterCount) {
+        for (int i = 0; i < CounterCount; ++i) {
+            mValues[i] += data[i + 1];
+        }
+    }
+#endif
+}
+
+quint64 PerfCounters::value(Counter counter) const
+{
+    return mValues[counter];
+}
+
+const char *PerfCounters::name(Counter counter)
+{
+    switch (counter) {
+    case Instructions:
+        return "instructions";
+    case Cycles:
+        return "cycles";
+    case CacheMisses:
+        return "cache-misses";
+    case BranchMisses:
+        return "branch-misses";
+    case CounterCount:
+        break;
+    }
+    return "";
+}
@@ -0,0 +1,53 @@
+/*
+    SPDX-FileCopyrightText: 2026 KAsync contributors
+
+    SPDX-License-Identifier: GPL-2.0-only OR GPL-3.0-only OR LicenseRef-KDE-Accepted-GPL
+*/
+
+#ifndef KASYNC_PERFCOUNTERS_H
+#define KASYNC_PERFCOUNTERS_H
+
+#include <QtGlobal>
+
+/**
+ * Hardware performance counters of the calling thread.
+ *
+ * Uses perf_event_open() on Linux. The counters are unavailable on other
+ * platforms, or if the kernel does not allow to open them (see
+ * /proc/sys/kernel/perf_event_paranoid), in which case start() and stop()
+ * do nothing.
+ */
+class PerfCounters
+{
+public:
+    enum Counter {
+        Instructions,
+        Cycles,
+        CacheMisses,
+        BranchMisses,
+        CounterCount
+    };
+
+    PerfCounters();
+    ~PerfCounters();
+
+    bool isAvailable() const;
+
+    /**
+     * Counts until the next stop(), adding to the counts so far.
+     */
+    void start();
+    void stop();
+
+    quint64 value(Counter counter) const;
+
+    static const char *name(Counter counter);
+
+private:
+    Q_DISABLE_COPY(PerfCounters)
+
+    int mFds[CounterCount];
+    quint64 mValues[CounterCount];
+};
+
+#endif
@@ -12,6 +12,7 @@
 #include "kasync_export.h"
 
 #include <functional>
+#include <tuple>
 #include <type_traits>
 #include <cassert>
 
@@ -20,6 +21,7 @@
 #include "future.h"
 #include "debug.h"
 
+#include "completionlatch_p.h"
 #include "continuations_p.h"
 #include "executor_p.h"
 
@@ -66,6 +68,9 @@ class JobBase;
 template<typename Out, typename ... In>
 class Job;
 
+template<typename Out, typename ... In>
+class PreparedJob;
+
 //@cond PRIVATE
 namespace Private {
 
@@ -73,10 +78,22 @@ template<typename Out, typename ... In>
 Job<Out, In ...> startImpl(Private::ContinuationHolder<Out, In ...> &&helper)
 {
     static_assert(sizeof...(In) <= 1, "Only one or zero input parameters are allowed.");
-    return Job<Out, In...>(QSharedPointer<Private::Executor<Out, In ...>>::create(
+    return Job<Out, In...>(Private::IntrusivePtr<Private::Executor<Out, In ...>>::create(
                 std::forward<Private::ContinuationHolder<Out, In...>>(helper), nullptr, Private::ExecutionFlag::GoodCase));
 }
 
+/**
+ * Starts @p job as part of the step being run on this thread, for the
+ * functions that run jobs of their own, like forEach(). Unlike Job::exec(),
+ * the job sees the values of the running execution and is cancelled
+ * together with it.
+ */
+template<typename Out>
+KAsync::Future<Out> startNested(const Job<Out> &job);
+
+template<typename Out, typename In, typename FirstIn>
+KAsync::Future<Out> startNested(const Job<Out, In> &job, FirstIn in);
+
 } // namespace Private
 //@endcond
 
@@ -149,6 +166,8 @@ KASYNC_EXPORT Job<void> doWhile(const JobContinuation<ControlFlowFlag> &body);
  * @relates Job
  *
  * Async delay.
+ *
+ * The delay is measured by the installed TimerSource.
  */
 KASYNC_EXPORT Job<void> wait(int delay);
 
@@ -224,6 +243,55 @@ Job<void, List> serialForEach(JobContinuation<void, ValueType> &&);
 template<template<typename> class Container>
 Job<void> waitForCompletion(Container<KAsync::Future<void>> &futures);
 
+/**
+ * @relates Job
+ *
+ * Collects the values of the given futures.
+ *
+ * The job finishes once all @p futures are finished, with their values in
+ * the order of @p futures. If any of them failed, the job fails with the
+ * error of the first one that failed instead.
+ *
+ * The values are copied out of the futures, which can still be read
+ * afterwards, or be passed to other jobs.
+ *
+ * @see whenAllSettled()
+ */
+template<typename T>
+Job<QVector<T>> whenAll(const QVector<KAsync::Future<T>> &futures);
+
+/**
+ * @relates Job
+ *
+ * Collects the outcome of each of the given futures.
+ *
+ * Like whenAll(), the job however never fails. The result of each future
+ * holds either its value or its error.
+ */
+template<typename T>
+Job<QVector<Result<T>>> whenAllSettled(const QVector<KAsync::Future<T>> &futures);
+
+/**
+ * @relates Job
+ *
+ * Runs the given jobs in parallel.
+ *
+ * All @p jobs are started at once when the returned job runs, so that
+ * independent asynchronous operations overlap. The job finishes once all
+ * of them are finished, with a tuple of their values. If any of them
+ * failed, the job fails with the error of the first one in the argument
+ * order instead.
+ *
+ * @code
+ * KAsync::parallel(fetchUser(id), fetchPermissions(id))
+ *     .then([](const std::tuple<User, Permissions> &result) {
+ *         ...
+ *     });
+ * @endcode
+ */
+template<typename ... Out>
+Job<std::tuple<Out ...>> parallel(Job<Out> ... jobs);
+
 /**
  * @relates Job
  *
@@ -257,12 +325,70 @@ Job<Out> error(const char *);
 template<typename Out = void>
 Job<Out> error(const Error &);
 
+/**
+ * @brief Values that are available to all continuations of an execution.
+ *
+ * Per-execution state, like a request id, a deadline or an authentication
+ * token, can be passed to Job::exec() once instead of being captured by
+ * every continuation of the job. The values are looked up by their type with
+ * executionValue(), so wrap values of common types into a struct of their
+ * own. Nested jobs see the values of the execution that runs them.
+ */
+class ExecutionValues
+{
+public:
+    /**
+     * Sets the value of type @p T, replacing a previous value of that type.
+     */
+    template<typename T>
+    ExecutionValues &set(const T &value)
+    {
+        if (!d) {
+            d = QSharedDataPointer<Private::ValueSlots>(new Private::ValueSlots);
+        }
+        d->set(value);
+        return *this;
+    }
+
+    /**
+     * Returns the value of type @p T, or nullptr if there is none.
+     */
+    template<typename T>
+    const T *get() const
+    {
+        return !d ? nullptr : d.constData()->template get<T>();
+    }
+
+private:
+    template<typename Out, typename ... In>
+    friend class Job;
+    template<typename Out, typename ... In>
+    friend class PreparedJob;
+
+    QSharedDataPointer<Private::ValueSlots> d;
+};
+
+/**
+ * @relates Job
+ *
+ * Returns the value of type @p T of the running execution, as passed to
+ * Job::exec() with ExecutionValues, or nullptr if there is none.
+ *
+ * The values are available while a continuation is called, an asynchronous
+ * continuation has to copy what it needs for later.
+ */
+template<typename T>
+const T *executionValue();
+
 //@cond PRIVATE
 class KASYNC_EXPORT JobBase
 {
     template<typename Out, typename ... In>
     friend class Job;
 
+    template<typename Out, typename ... In>
+    friend class Private::Executor;
+
 public:
     explicit JobBase(const Private::ExecutorBasePtr &executor)
         : mExecutor(executor)
@@ -333,6 +459,15 @@ class [[nodiscard]] Job : public JobBase
     template<typename List, typename ValueType>
     friend Job<void, List> serialForEach(KAsync::Job<void, ValueType> job);
 
+    template<typename OutOther, typename ... InOther>
+    friend class PreparedJob;
+
+    template<typename OutOther>
+    friend KAsync::Future<OutOther> Private::startNested(const Job<OutOther> &);
+
+    template<typename OutOther, typename InOther, typename FirstIn>
+    friend KAsync::Future<OutOther> Private::startNested(const Job<OutOther, InOther> &, FirstIn);
+
     // Used to disable implicit conversion of Job<void to Job<void> which triggers
     // comiler warning.
     struct IncompleteType;
@@ -495,13 +630,14 @@ public:
      * The context is guaranteed to persist until the jobs execution has finished.
      *
      * Useful for setting smart pointer to manage lifetime of objects required
-     * during the execution of the job.
+     * during the execution of the job. The value can be of any copyable type,
+     * it does not need to be registered as a metatype.
      */
     template<typename T>
     Job<Out, In ...> &addToContext(const T &value)
     {
         assert(mExecutor);
-        mExecutor->addToContext(QVariant::fromValue<T>(value));
+        mExecutor->addToContext(value);
         return *this;
     }
 
@@ -518,6 +654,22 @@ public:
         return *this;
     }
 
+    /**
+     * Names the last step of the job.
+     *
+     * Named steps show up under this name in traces, and their invocations
+     * are measured while Metrics are enabled. Steps sharing a name are
+     * aggregated together.
+     *
+     * @see Metrics
+     */
+    Job<Out, In ...> &named(const char *name)
+    {
+        assert(mExecutor);
+        mExecutor->setLabel(Private::stepLabel(name));
+        return *this;
+    }
+
     /**
      * @brief Starts execution of the job chain.
      *
@@ -550,6 +702,63 @@ public:
      */
     KAsync::Future<Out> exec();
 
+    /**
+     * @brief Starts execution of the job chain with per-execution values.
+     *
+     * Like exec(FirstIn in), all continuations can however read @p values
+     * with executionValue().
+     *
+     * @see ExecutionValues
+     */
+    template<typename FirstIn>
+    KAsync::Future<Out> exec(FirstIn in, const ExecutionValues &values);
+
+    /**
+     * @brief Starts execution of the job chain with per-execution values.
+     *
+     * Like exec(), all continuations can however read @p values with
+     * executionValue().
+     *
+     * @see ExecutionValues
+     */
+    KAsync::Future<Out> exec(const ExecutionValues &values);
+
+    /**
+     * @brief Runs the job chain synchronously.
+     *
+     * Runs all steps of the chain on the calling thread before returning,
+     * without allocating the Futures and other state used by exec(). This
+     * requires all steps to be synchronous continuations, e.g. lambdas
+     * returning a value instead of a Job or taking a Future, or steps made
+     * with value() or null(). If any step is not synchronous, nothing is run
+     * and an error is returned instead.
+     *
+     * Errors are propagated like with exec(). Executions started this way
+     * are not traced nor reported by Introspection, named steps are however
+     * measured while Metrics are enabled.
+     *
+     * @param in Argument to be passed to the very first task
+     * @return The result of the last task, or its error
+     *
+     * @see exec(FirstIn in), Result
+     */
+    template<typename FirstIn>
+    Result<Out> execSync(FirstIn in);
+
+    /**
+     * @brief Runs the job chain synchronously.
+     *
+     * @see execSync(FirstIn in)
+     */
+    Result<Out> execSync();
+
+    /**
+     * @brief Prepares the job for being executed many times.
+     *
+     * @see PreparedJob
+     */
+    PreparedJob<Out, In ...> prepare() const;
+
     explicit Job(JobContinuation<Out, In ...> &&func);
     explicit Job(AsyncContinuation<Out, In ...> &&func);
 
@@ -557,6 +766,11 @@ private:
     //@cond PRIVATE
     explicit Job(Private::ExecutorBasePtr executor);
 
+    KAsync::Future<Out> execImpl(void *firstIn, const ExecutionValues &values,
+                                 Private::ExecutionPool *pool = nullptr);
+    KAsync::Future<Out> execImpl(void *firstIn, const Private::ExecutionContext::Ptr &context) const;
+    Result<Out> execSyncImpl(const void *firstIn);
+
     template<typename OutOther, typename ... InOther>
     Job<OutOther, In ...> thenImpl(Private::ContinuationHolder<OutOther, InOther ...> helper,
                                    Private::ExecutionFlag execFlag = Private::ExecutionFlag::GoodCase) const;
@@ -573,6 +787,81 @@ private:
     //@endcond
 };
 
+/**
+ * @brief A job prepared for being executed many times.
+ *
+ * Job::prepare() checks once how the steps of the job can be run, so that
+ * exec() does as little work as possible for jobs that are run over and
+ * over. Jobs made of synchronous steps only are run like with
+ * Job::execSync(), without any per-step state, and exec() returns an
+ * already finished Future. The executions of other jobs are recycled
+ * between runs instead of being allocated for every run.
+ *
+ * Apart from that, exec() behaves like Job::exec(). The job must not be
+ * changed, e.g. with guard() or named(), once it is prepared.
+ *
+ * @code
+ * auto parse = KAsync::start<Message, QByteArray>(&parseMessage)
+ *     .then(&validateMessage)
+ *     .prepare();
+ * for (const QByteArray &data : packets) {
+ *     parse.exec(data);
+ * }
+ * @endcode
+ */
+template<typename Out, typename ... In>
+class PreparedJob
+{
+public:
+    /**
+     * @brief Starts execution of the job chain.
+     *
+     * @see Job::exec(FirstIn in)
+     */
+    template<typename FirstIn>
+    KAsync::Future<Out> exec(FirstIn in);
+
+    /**
+     * @brief Starts execution of the job chain.
+     *
+     * @see Job::exec()
+     */
+    KAsync::Future<Out> exec();
+
+    /**
+     * @brief Starts execution of the job chain with per-execution values.
+     *
+     * @see Job::exec(FirstIn in, const ExecutionValues &values)
+     */
+    template<typename FirstIn>
+    KAsync::Future<Out> exec(FirstIn in, const ExecutionValues &values);
+
+    /**
+     * @brief Starts execution of the job chain with per-execution values.
+     *
+     * @see Job::exec(const ExecutionValues &values)
+     */
+    KAsync::Future<Out> exec(const ExecutionValues &values);
+
+private:
+    //@cond PRIVATE
+    friend class Job<Out, In ...>;
+
+    explicit PreparedJob(const Job<Out, In ...> &job);
+
+    KAsync::Future<Out> execImpl(void *firstIn, const ExecutionValues &values);
+
+    template<typename T>
+    static void applyResult(Result<T> &result, KAsync::Future<T> &future);
+    static void applyResult(Result<void> &result, KAsync::Future<void> &future);
+
+    Job<Out, In ...> mJob;
+    Private::SyncExecution mSync;
+    bool mSynchronous;
+    Private::IntrusivePtr<Private::ExecutionPool> mPool;
+    //@endcond
+};
+
 } // namespace KAsync
 
 
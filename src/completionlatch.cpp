@@ -0,0 +1,53 @@
+/*
+    SPDX-FileCopyrightText: 2026 KAsync contributors
+
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#include "completionlatch_p.h"
+
+using namespace KAsync;
+using Private::CompletionLatch;
+
+CompletionLatch::CompletionLatch(int count, std::function<void()> done)
+    : mDone(std::move(done))
+{
+    // The hooks are linked into the Futures, so they must never move
+    mHooks.reserve(count);
+}
+
+void CompletionLatch::wait(FutureBase &future)
+{
+    Q_ASSERT(mHooks.size() < mHooks.capacity());
+    mHooks.emplace_back();
+    Hook &hook = mHooks.back();
+    hook.callback = &CompletionLatch::futureFinished;
+    hook.latch = this;
+    // Counted before the hook is added, as it may be called right away if
+    // the Future is finished on another thread. The count cannot drop to
+    // zero before start() is called.
+    mPending.fetch_add(1, std::memory_order_relaxed);
+    if (!future.addFinishedHook(&hook)) {
+        mPending.fetch_sub(1, std::memory_order_relaxed);
+        mHooks.pop_back();
+    }
+}
+
+void CompletionLatch::start()
+{
+    countDown();
+}
+
+void CompletionLatch::futureFinished(FinishedHook *hook)
+{
+    static_cast<Hook *>(hook)->latch->countDown();
+}
+
+void CompletionLatch::countDown()
+{
+    if (mPending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        const auto done = std::move(mDone);
+        delete this;
+        done();
+    }
+}
@@ -0,0 +1,92 @@
+/*
+    SPDX-FileCopyrightText: 2026 KAsync contributors
+
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#ifndef KASYNC_COMPLETIONLATCH_P_H_
+#define KASYNC_COMPLETIONLATCH_P_H_
+
+#include "kasync_export.h"
+
+#include "future.h"
+
+#include <atomic>
+#include <functional>
+#include <vector>
+
+namespace KAsync {
+
+//@cond PRIVATE
+namespace Private
+{
+
+/**
+ * Calls a function once a number of Futures are finished.
+ *
+ * The latch counts the pending Futures down as their FinishedHooks are
+ * called, so it allocates the same whatever the number of Futures, and
+ * each finished Future is handled in constant time. It is allocated with
+ * new and deletes itself once it is done. The Futures may be finished on
+ * other threads while they are waited for, the function is then called
+ * from the thread finishing the last one.
+ */
+class KASYNC_EXPORT CompletionLatch
+{
+public:
+    /**
+     * Prepares for waiting for up to @p count Futures, @p done is called
+     * once all of them are finished.
+     */
+    CompletionLatch(int count, std::function<void()> done);
+
+    CompletionLatch(const CompletionLatch &) = delete;
+    CompletionLatch &operator=(const CompletionLatch &) = delete;
+
+    /**
+     * Calls @p done once all @p futures are finished.
+     */
+    template<typename Container>
+    static void waitForAll(const Container &futures, std::function<void()> done)
+    {
+        auto latch = new CompletionLatch(static_cast<int>(futures.size()), std::move(done));
+        for (auto future : futures) {
+            latch->wait(future);
+        }
+        latch->start();
+    }
+
+    /**
+     * Waits for @p future, unless it is already finished.
+     */
+    void wait(FutureBase &future);
+
+    /**
+     * Called after the last wait(), calls the function right away if no
+     * Future is pending.
+     */
+    void start();
+
+private:
+    struct Hook : FinishedHook
+    {
+        CompletionLatch *latch;
+    };
+
+    ~CompletionLatch() = default;
+
+    static void futureFinished(FinishedHook *hook);
+    void countDown();
+
+    // One more than the pending Futures until start() is called
+    std::atomic<int> mPending{1};
+    std::vector<Hook> mHooks;
+    std::function<void()> mDone;
+};
+
+} // namespace Private
+//@endcond
+
+} // namespace KAsync
+
+#endif
@@ -6,15 +6,26 @@
 
 #include "debug.h"
 #include "async.h"
+#include "metrics.h"
 
 #include <QStringBuilder>
+#include <QCoreApplication>
+#include <QFile>
+#include <QHash>
+#include <QMutex>
+
+#include <algorithm>
+#include <chrono>
+#include <typeinfo>
+#include <vector>
 
 #ifdef __GNUG__
 #include <cxxabi.h>
-#include <memory>
 #include <cstdlib>
 #endif
 
+#include <memory>
+
 namespace KAsync
 {
 
@@ -40,10 +51,163 @@ QString demangleName(const char *name)
 
 using namespace KAsync;
 
-int Tracer::lastId = 0;
+namespace {
+
+struct TraceRecord
+{
+    qint64 timestamp; // nanoseconds, steady clock
+    quint64 executionId;
+    quintptr executor;
+    const char *name; // step name or mangled type name, has static storage duration
+    int type;
+};
+
+// A record in the ring buffer. The fields are atomic, so that readers on
+// other threads may copy a record while it is being overwritten. The stamp
+// tells them whether they did.
+struct TraceSlot
+{
+    // Position of the record plus one, 0 while it is being written
+    std::atomic<quint64> stamp{0};
+    std::atomic<qint64> timestamp{0};
+    std::atomic<quint64> executionId{0};
+    std::atomic<quintptr> executor{0};
+    std::atomic<const char *> name{nullptr};
+    std::atomic<int> type{0};
+};
+
+// Single producer (the owning thread), lock-free ring buffer. Readers skip
+// the records that are overwritten while they read them.
+struct TraceBuffer
+{
+    enum { Capacity = 1 << 14 };
+
+    explicit TraceBuffer(int threadIndex)
+        : records(new TraceSlot[Capacity])
+        , threadIndex(threadIndex)
+    {}
+
+    void append(const TraceRecord &record)
+    {
+        const quint64 pos = head.load(std::memory_order_relaxed);
+        TraceSlot &slot = records[pos & (Capacity - 1)];
+        slot.stamp.store(0, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        slot.timestamp.store(record.timestamp, std::memory_order_relaxed);
+        slot.executionId.store(record.executionId, std::memory_order_relaxed);
+        slot.executor.store(record.executor, std::memory_order_relaxed);
+        slot.name.store(record.name, std::memory_order_relaxed);
+        slot.type.store(record.type, std::memory_order_relaxed);
+        slot.stamp.store(pos + 1, std::memory_order_release);
+        head.store(pos + 1, std::memory_order_release);
+    }
+
+    // Copies the record at pos into record, returns false if it has been
+    // overwritten before or while copying it.
+    bool read(quint64 pos, TraceRecord &record) const
+    {
+        const TraceSlot &slot = records[pos & (Capacity - 1)];
+        if (slot.stamp.load(std::memory_order_acquire) != pos + 1) {
+            return false;
+        }
+        record.timestamp = slot.timestamp.load(std::memory_order_relaxed);
+        record.executionId = slot.executionId.load(std::memory_order_relaxed);
+        record.executor = slot.executor.load(std::memory_order_relaxed);
+        record.name = slot.name.load(std::memory_order_relaxed);
+        record.type = slot.type.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return slot.stamp.load(std::memory_order_relaxed) == pos + 1;
+    }
+
+    std::unique_ptr<TraceSlot[]> records;
+    std::atomic<quint64> head{0};
+    std::atomic<quint64> tail{0};
+    const int threadIndex;
+    bool threadFinished = false; // guarded by the registry mutex
+};
+
+struct TraceRegistry
+{
+    QMutex mutex;
+    std::vector<std::unique_ptr<TraceBuffer>> buffers;
+    int lastThreadIndex = 0;
+
+    // Must be called with the mutex locked
+    void release(const TraceBuffer *buffer)
+    {
+        buffers.erase(std::find_if(buffers.begin(), buffers.end(),
+                                   [buffer](const std::unique_ptr<TraceBuffer> &b) { return b.get() == buffer; }));
+    }
+};
+
+TraceRegistry &traceRegistry()
+{
+    static TraceRegistry registry;
+    return registry;
+}
+
+// The buffer of a thread stays registered after the thread has exited, so
+// that its events can still be exported, until they are cleared.
+struct ThreadTraceBuffer
+{
+    ~ThreadTraceBuffer()
+    {
+        if (!buffer) {
+            return;
+        }
+        auto &registry = traceRegistry();
+        QMutexLocker locker(&registry.mutex);
+        buffer->threadFinished = true;
+        if (buffer->head.load(std::memory_order_relaxed) == buffer->tail.load(std::memory_order_relaxed)) {
+            registry.release(buffer);
+        }
+    }
+
+    TraceBuffer *buffer = nullptr;
+};
+
+TraceBuffer *threadTraceBuffer()
+{
+    thread_local ThreadTraceBuffer threadBuffer;
+    if (!threadBuffer.buffer) {
+        auto &registry = traceRegistry();
+        QMutexLocker locker(&registry.mutex);
+        registry.buffers.push_back(std::make_unique<TraceBuffer>(++registry.lastThreadIndex));
+        threadBuffer.buffer = registry.buffers.back().get();
+    }
+    return threadBuffer.buffer;
+}
+
+qint64 traceTimestamp()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+std::atomic<quint64> lastId{0};
+
+void appendJsonString(QByteArray &out, const QByteArray &str)
+{
+    out += '"';
+    for (const char c : str) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (static_cast<uchar>(c) < 0x20) {
+            out += ' ';
+        } else {
+            out += c;
+        }
+    }
+    out += '"';
+}
+
+}
+
+std::atomic<bool> Tracer::sEnabled{qEnvironmentVariableIsSet("KASYNC_TRACE")};
 
 Tracer::Tracer(Private::Execution *execution)
-    : mId(lastId++)
+    : mId(++lastId)
     , mExecution(execution)
 {
     msg(KAsync::Tracer::Start);
@@ -52,15 +216,102 @@ Tracer::Tracer(Private::Execution *execution)
 Tracer::~Tracer()
 {
     msg(KAsync::Tracer::End);
-    // FIXME: Does this work on parallel executions?
-    --lastId;
-    --mId;
+}
+
+void Tracer::step()
+{
+    msg(KAsync::Tracer::Step);
 }
 
 void Tracer::msg(Tracer::MsgType msgType)
 {
-    qCDebug(Trace).nospace() << (QString().fill(QLatin1Char(' '), mId * 2) % 
-                                 (msgType == KAsync::Tracer::Start ? QStringLiteral(" START ") : QStringLiteral(" END   ")) %
+    const auto &executor = *mExecution->executor;
+    const char *name = executor.stepName();
+    threadTraceBuffer()->append({traceTimestamp(), mId, reinterpret_cast<quintptr>(&executor),
+                                 name, msgType});
+
+    qCDebug(Trace).nospace() << ((msgType == KAsync::Tracer::Start ? QStringLiteral(" START ") :
+                                  msgType == KAsync::Tracer::End ? QStringLiteral(" END   ") : QStringLiteral(" STEP  ")) %
                                  QString::number(mId) % QStringLiteral(" ") %
-                                 mExecution->executor->mExecutorName);
+                                 demangleName(name));
+}
+
+void Tracer::setEnabled(bool enabled)
+{
+    sEnabled.store(enabled, std::memory_order_relaxed);
+}
+
+void Tracer::clear()
+{
+    auto &registry = traceRegistry();
+    QMutexLocker locker(&registry.mutex);
+    auto &buffers = registry.buffers;
+    buffers.erase(std::remove_if(buffers.begin(), buffers.end(),
+                                 [](const std::unique_ptr<TraceBuffer> &buffer) { return buffer->threadFinished; }),
+                  buffers.end());
+    for (const auto &buffer : buffers) {
+        buffer->tail.store(buffer->head.load(std::memory_order_acquire), std::memory_order_relaxed);
+    }
+}
+
+QByteArray Tracer::chromeTrace()
+{
+    static const char *const phases[] = { "b", "e", "n" };
+
+    QHash<const char *, QByteArray> names;
+    const QByteArray pid = QByteArray::number(QCoreApplication::applicationPid());
+
+    QByteArray out = "{\"traceEvents\":[";
+    bool first = true;
+    auto &registry = traceRegistry();
+    QMutexLocker locker(&registry.mutex);
+    for (const auto &buffer : registry.buffers) {
+        const QByteArray tid = QByteArray::number(buffer->threadIndex);
+        const quint64 head = buffer->head.load(std::memory_order_acquire);
+        const quint64 tail = std::max(buffer->tail.load(std::memory_order_relaxed),
+                                      head > TraceBuffer::Capacity ? head - TraceBuffer::Capacity : 0);
+        for (quint64 pos = tail; pos < head; ++pos) {
+            TraceRecord record;
+            if (!buffer->read(pos, record)) {
+                continue;
+            }
+            auto name = names.find(record.name);
+            if (name == names.end()) {
+                name = names.insert(record.name, demangleName(record.name).toUtf8());
+            }
+            out += first ? "\n{" : ",\n{";
+            first = false;
+            out += "\"name\":";
+            appendJsonString(out, *name);
+            out += ",\"cat\":\"kasync\",\"ph\":\"";
+            out += phases[record.type];
+            out += "\",\"id\":" + QByteArray::number(record.executionId);
+            out += ",\"ts\":" + QByteArray::number(record.timestamp / 1000) + '.'
+                   + QByteArray::number(record.timestamp % 1000 + 1000).mid(1);
+            out += ",\"pid\":" + pid + ",\"tid\":" + tid;
+            out += ",\"args\":{\"executor\":\"0x" + QByteArray::number(static_cast<qulonglong>(record.executor), 16) + "\"}}";
+        }
+        out += first ? "\n{" : ",\n{";
+        first = false;
+        out += "\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" + pid + ",\"tid\":" + tid
+               + ",\"args\":{\"name\":\"KAsync thread " + tid + "\"}}";
+    }
+    out += "\n],\"displayTimeUnit\":\"ns\"}\n";
+    return out;
+}
+
+bool Tracer::writeChromeTrace(QIODevice *device)
+{
+    const QByteArray trace = chromeTrace();
+    return device->write(trace) == trace.size();
+}
+
+bool Tracer::writeChromeTrace(const QString &fileName)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qCWarning(Debug) << "Failed to open" << fileName << "for writing the trace";
+        return false;
+    }
+    return writeChromeTrace(&file);
 }
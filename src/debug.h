@@ -13,10 +13,13 @@
 
 #include <QLoggingCategory>
 #include <QStringBuilder>
+#include <QByteArray>
+
+#include <atomic>
 
-#ifndef QT_NO_DEBUG
 #include <typeinfo>
-#endif
+
+class QIODevice;
 
 namespace KAsync
 {
@@ -31,43 +34,83 @@ namespace Private
 struct Execution;
 }
 
+/**
+ * @brief Records the lifecycle of job executions.
+ *
+ * The tracer is compiled into all builds but disabled by default, in which
+ * case the only cost is a single check of isEnabled() per executed step.
+ * Once enabled, the start and the end of each Execution as well as the
+ * moment its continuation is invoked are recorded as fixed-size records
+ * into a lock-free ring buffer owned by the recording thread. Only the
+ * latest records are kept, older ones are overwritten.
+ *
+ * The recorded data can be exported in the Chrome trace event format and
+ * inspected with chrome://tracing or Perfetto. If the org.kde.async.trace
+ * logging category is enabled, the events are additionally logged.
+ *
+ * Tracing can also be enabled from the start by setting the KASYNC_TRACE
+ * environment variable.
+ */
 class KASYNC_EXPORT Tracer
 {
 public:
     explicit Tracer(Private::Execution *execution);
     ~Tracer();
 
+    /**
+     * Records that the continuation of the traced execution is being invoked.
+     */
+    void step();
+
+    /**
+     * Enables or disables recording of new trace events.
+     */
+    static void setEnabled(bool enabled);
+
+    static bool isEnabled()
+    {
+        return sEnabled.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * Discards all events recorded so far, and releases the buffers of the
+     * threads that have exited meanwhile.
+     */
+    static void clear();
+
+    /**
+     * Returns the recorded events in the Chrome trace event JSON format.
+     *
+     * Events that are being recorded while the trace is exported may be
+     * incomplete, so preferably export only after the traced jobs are done.
+     */
+    static QByteArray chromeTrace();
+
+    /**
+     * Writes the recorded events in the Chrome trace event JSON format to @p device.
+     */
+    static bool writeChromeTrace(QIODevice *device);
+
+    /**
+     * Writes the recorded events in the Chrome trace event JSON format to file
+     * @p fileName.
+     */
+    static bool writeChromeTrace(const QString &fileName);
+
 private:
     enum MsgType {
         Start,
-        End
+        End,
+        Step
     };
     void msg(MsgType);
 
-    int mId;
+    quint64 mId;
     Private::Execution *mExecution;
 
-    static int lastId;
+    static std::atomic<bool> sEnabled;
 };
 
 }
 
-#ifndef QT_NO_DEBUG
-    template<typename T>
-    QString storeExecutorNameExpanded() {
-        return KAsync::demangleName(typeid(T).name());
-    }
-
-    template<typename T, typename ... Tail>
-    auto storeExecutorNameExpanded() -> std::enable_if_t<sizeof ... (Tail) != 0, QString>
-    {
-        return storeExecutorNameExpanded<T>() % QStringLiteral(", ") % storeExecutorNameExpanded<Tail ...>();
-    }
-
-    #define STORE_EXECUTOR_NAME(name, ...) \
-        ExecutorBase::mExecutorName = QStringLiteral(name "<") % storeExecutorNameExpanded<__VA_ARGS__>() % QStringLiteral(">")
-#else
-    #define STORE_EXECUTOR_NAME(...)
-#endif
-
 #endif // KASYNC_DEBUG_H
@@ -0,0 +1,268 @@
+/*
+    SPDX-FileCopyrightText: 2026 KAsync contributors
+
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#include "execution_p.h"
+
+#include <QMutexLocker>
+
+#include <algorithm>
+#include <cstddef>
+
+using namespace KAsync;
+using Private::Execution;
+using Private::ExecutionContext;
+using Private::ExecutionGuard;
+using Private::ExecutionPool;
+
+namespace {
+thread_local const ExecutionContext::Ptr *currentContext = nullptr;
+
+// Precedes each execution, to find the pool it is returned to
+struct alignas(std::max_align_t) BlockHeader {
+    ExecutionPool *pool;
+};
+
+constexpr std::size_t PoolBlockSize = sizeof(BlockHeader) + sizeof(Execution);
+}
+
+ExecutionPool::ExecutionPool()
+{
+    mFreeBlocks.reserve(MaxFreeBlocks);
+}
+
+ExecutionPool::~ExecutionPool()
+{
+    for (void *block : mFreeBlocks) {
+        ::operator delete(block);
+    }
+}
+
+void *ExecutionPool::allocate()
+{
+    {
+        QMutexLocker locker(&mMutex);
+        if (!mFreeBlocks.empty()) {
+            void *block = mFreeBlocks.back();
+            mFreeBlocks.pop_back();
+            return block;
+        }
+    }
+    return ::operator new(PoolBlockSize);
+}
+
+void ExecutionPool::release(void *block)
+{
+    {
+        QMutexLocker locker(&mMutex);
+        if (mFreeBlocks.size() < MaxFreeBlocks) {
+            mFreeBlocks.push_back(block);
+            return;
+        }
+    }
+    ::operator delete(block);
+}
+
+void *Execution::operator new(std::size_t size, ExecutionPool *pool)
+{
+    BlockHeader *header;
+    if (pool && size == sizeof(Execution)) {
+        pool->ref();
+        header = static_cast<BlockHeader *>(pool->allocate());
+    } else {
+        pool = nullptr;
+        header = static_cast<BlockHeader *>(::operator new(sizeof(BlockHeader) + size));
+    }
+    header->pool = pool;
+    return header + 1;
+}
+
+void Execution::operator delete(void *ptr, ExecutionPool *)
+{
+    Execution::operator delete(ptr);
+}
+
+void Execution::operator delete(void *ptr)
+{
+    BlockHeader *header = static_cast<BlockHeader *>(ptr) - 1;
+    ExecutionPool *pool = header->pool;
+    if (!pool) {
+        ::operator delete(header);
+        return;
+    }
+    pool->release(header);
+    if (!pool->deref()) {
+        delete pool;
+    }
+}
+
+ExecutionContext::Scope::Scope(const Ptr *context)
+    : mPrevious(currentContext)
+{
+    currentContext = context;
+}
+
+ExecutionContext::Scope::~Scope()
+{
+    currentContext = mPrevious;
+}
+
+ExecutionContext::~ExecutionContext()
+{
+    if (mParent) {
+        QMutexLocker locker(&mParent->mMutex);
+        auto &siblings = mParent->mChildren;
+        siblings.erase(std::remove_if(siblings.begin(), siblings.end(),
+                                      [](const QWeakPointer<ExecutionContext> &c) { return c.isNull(); }),
+                       siblings.end());
+    }
+}
+
+void ExecutionContext::addGuard(const Ptr &context, ExecutionGuard &guard)
+{
+    if (!context->firstGuard) {
+        context->firstGuard = guard.object;
+    }
+    context->mCancellable = true;
+    guard.addContext(context);
+}
+
+void ExecutionContext::setParent(const Ptr &context, const Ptr &parent)
+{
+    if (!parent->mCancellable) {
+        return;
+    }
+    context->mParent = parent;
+    context->mCancellable = true;
+    {
+        QMutexLocker locker(&parent->mMutex);
+        parent->mChildren.push_back(context);
+    }
+    if (parent->guardIsBroken()) {
+        context->cancel();
+    }
+}
+
+const ExecutionContext::Ptr &ExecutionContext::current()
+{
+    static const Ptr none;
+    return currentContext ? *currentContext : none;
+}
+
+ExecutionContext::Ptr ExecutionContext::createNested()
+{
+    auto context = Ptr::create();
+    if (const Ptr &parent = current()) {
+        setParent(context, parent);
+        context->values = parent->values;
+        context->pool = parent->pool;
+    }
+    return context;
+}
+
+int ExecutionContext::addCancelHook(std::function<void()> callback)
+{
+    if (!mCancellable) {
+        return 0;
+    }
+    QMutexLocker locker(&mMutex);
+    mCancelHooks.push_back({++mLastCancelHook, std::move(callback)});
+    return mLastCancelHook;
+}
+
+void ExecutionContext::removeCancelHook(int id)
+{
+    std::function<void()> callback;
+    QMutexLocker locker(&mMutex);
+    for (auto it = mCancelHooks.begin(); it != mCancelHooks.end(); ++it) {
+        if (it->first == id) {
+            // Destroyed after the lock is released, it may hold the last
+            // reference to a context
+            callback = std::move(it->second);
+            mCancelHooks.erase(it);
+            break;
+        }
+    }
+}
+
+void ExecutionContext::cancel()
+{
+    if (mCancelled.exchange(true, std::memory_order_acq_rel)) {
+        return;
+    }
+    QMutexLocker locker(&mMutex);
+    const auto children = mChildren;
+    const auto hooks = std::move(mCancelHooks);
+    mCancelHooks.clear();
+    locker.unlock();
+
+    for (const auto &weak : children) {
+        if (const Ptr child = weak.toStrongRef()) {
+            child->cancel();
+        }
+    }
+    for (const auto &hook : hooks) {
+        hook.second();
+    }
+}
+
+ExecutionGuard::Ptr ExecutionGuard::create(const QObject *object)
+{
+    Ptr guard(new ExecutionGuard(object));
+    if (object) {
+        // The weak pointer keeps the guard alive while it cancels the
+        // executions, even if its step is destroyed meanwhile
+        const QWeakPointer<ExecutionGuard> weak = guard;
+        guard->mConnection = QObject::connect(object, &QObject::destroyed, [weak]() {
+            if (const Ptr guard = weak.toStrongRef()) {
+                guard->cancel();
+            }
+        });
+    }
+    return guard;
+}
+
+ExecutionGuard::ExecutionGuard(const QObject *object)
+    : object(object)
+{
+}
+
+ExecutionGuard::~ExecutionGuard()
+{
+    QObject::disconnect(mConnection);
+}
+
+void ExecutionGuard::addContext(const ExecutionContext::Ptr &context)
+{
+    QMutexLocker locker(&mMutex);
+    if (mContexts.size() >= mPruneAt) {
+        mContexts.erase(std::remove_if(mContexts.begin(), mContexts.end(),
+                                       [](const QWeakPointer<ExecutionContext> &c) { return c.isNull(); }),
+                        mContexts.end());
+        mPruneAt = qMax(8, 2 * mContexts.size());
+    }
+    mContexts.push_back(context);
+    locker.unlock();
+
+    // The object is already reset when destroyed() is emitted, so if it was
+    // destroyed meanwhile the context is cancelled either here or by cancel()
+    if (!object) {
+        context->cancel();
+    }
+}
+
+void ExecutionGuard::cancel()
+{
+    QMutexLocker locker(&mMutex);
+    const auto contexts = std::move(mContexts);
+    mContexts.clear();
+    locker.unlock();
+
+    for (const auto &weak : contexts) {
+        if (const ExecutionContext::Ptr context = weak.toStrongRef()) {
+            context->cancel();
+        }
+    }
+}
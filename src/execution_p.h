@@ -12,21 +12,27 @@
 #include "kasync_export.h"
 
 #include "debug.h"
+#include "future.h"
+#include "metrics.h"
+#include "refcounted_p.h"
 
+#include <QMutex>
+#include <QSharedData>
 #include <QSharedPointer>
 #include <QPointer>
 #include <QVector>
 #include <QObject>
 
+#include <atomic>
+#include <cstddef>
+#include <functional>
 #include <memory>
+#include <new>
+#include <typeinfo>
+#include <vector>
 
 namespace KAsync {
 
-class FutureBase;
-
-template<typename T>
-class Future;
-
 class Tracer;
 
 //@cond PRIVATE
@@ -34,12 +40,16 @@ namespace Private
 {
 
 class ExecutorBase;
-using ExecutorBasePtr = QSharedPointer<ExecutorBase>;
+using ExecutorBasePtr = IntrusivePtr<ExecutorBase>;
 
 struct Execution;
-using ExecutionPtr = QSharedPointer<Execution>;
+using ExecutionPtr = IntrusivePtr<Execution>;
 
 class ExecutionContext;
+class ExecutionGuard;
+
+class ExecutionProfile;
+using ExecutionProfilePtr = QSharedPointer<ExecutionProfile>;
 
 enum ExecutionFlag {
     Always,
@@ -47,19 +57,39 @@ enum ExecutionFlag {
     GoodCase
 };
 
-struct KASYNC_EXPORT Execution {
-    explicit Execution(const ExecutorBasePtr &executor)
-        : executor(executor)
-    {}
+/**
+ * Recycles the memory of the executions of a PreparedJob, so that running
+ * the job again does not allocate it anew. Each execution taken from the
+ * pool keeps the pool alive until it is returned.
+ */
+class KASYNC_EXPORT ExecutionPool : public RefCounted
+{
+public:
+    ExecutionPool();
+    ~ExecutionPool();
 
-    virtual ~Execution()
-    {
-        if (resultBase) {
-            resultBase->releaseExecution();
-            delete resultBase;
-        }
-        prevExecution.reset();
-    }
+    void *allocate();
+    void release(void *block);
+
+private:
+    enum {
+        MaxFreeBlocks = 64
+    };
+
+    QMutex mMutex;
+    std::vector<void *> mFreeBlocks;
+};
+
+struct KASYNC_EXPORT Execution : public RefCounted
+                             , private InstanceCounter<TrackedObject::Execution> {
+    // Defined in executor_p.h, where ExecutorBase is complete
+    inline explicit Execution(const ExecutorBasePtr &executor);
+    inline virtual ~Execution();
+
+    // Allocates the execution from @p pool, or from the heap if it is null
+    static void *operator new(std::size_t size, ExecutionPool *pool);
+    static void operator delete(void *ptr, ExecutionPool *pool);
+    static void operator delete(void *ptr);
 
     void setFinished()
     {
@@ -80,23 +110,330 @@ struct KASYNC_EXPORT Execution {
     ExecutorBasePtr executor;
     ExecutionPtr prevExecution;
     std::unique_ptr<Tracer> tracer;
-    FutureBase *resultBase = nullptr;
+    FutureBase *resultBase = nullptr; // the Future in futureStorage, once created
+    qint64 runStart = 0; // only set if the step is measured, see Metrics
+    qint64 cpuTime = 0;
+    ExecutionProfilePtr profile; // only set while looking for slow executions
+    int profileStep = -1;
+
+    // Finishes an asynchronous step, see Executor::completeExecution()
+    struct FinishedHook : KAsync::Private::FinishedHook {
+        Execution *execution = nullptr;
+    } finishedHook;
+
+    // The Future of the step is stored in the execution rather than
+    // allocated on its own, all Future types have the layout of FutureBase
+    alignas(FutureBase) char futureStorage[sizeof(FutureBase)];
 };
 
-class ExecutionContext {
+/**
+ * A value of any copyable type, kept alive by a step (see
+ * Job::addToContext()) or by an execution (see ExecutionValues). Values
+ * that fit into the inline buffer, like smart pointers, are stored without
+ * an allocation of their own.
+ */
+class ContextEntry
+{
 public:
-    using Ptr = QSharedPointer<ExecutionContext>;
+    template<typename T>
+    explicit ContextEntry(const T &value)
+        : mOps(&ops<T>)
+    {
+        construct(mBuffer, value);
+    }
 
-    QVector<QPointer<const QObject>> guards;
-    bool guardIsBroken() const
+    ContextEntry(ContextEntry &&other) noexcept
+        : mOps(other.mOps)
     {
-        for (const auto &g : guards) {
-            if (!g) {
-                return true;
+        mOps->move(mBuffer, other.mBuffer);
+    }
+
+    ContextEntry(const ContextEntry &other)
+        : mOps(other.mOps)
+    {
+        mOps->copy(mBuffer, other.mBuffer);
+    }
+
+    ContextEntry &operator=(ContextEntry &&other) noexcept
+    {
+        if (this != &other) {
+            mOps->destroy(mBuffer);
+            mOps = other.mOps;
+            mOps->move(mBuffer, other.mBuffer);
+        }
+        return *this;
+    }
+
+    ContextEntry &operator=(const ContextEntry &) = delete;
+
+    ~ContextEntry()
+    {
+        mOps->destroy(mBuffer);
+    }
+
+    template<typename T>
+    bool holds() const
+    {
+        return mOps->type == typeid(T);
+    }
+
+    // Must only be called if holds<T>()
+    template<typename T>
+    const T &value() const
+    {
+        return *get<T>(mBuffer);
+    }
+
+private:
+    enum {
+        InlineSize = 2 * sizeof(void *)
+    };
+
+    struct Ops {
+        // Copies or moves the value to an uninitialized buffer. The moved
+        // from buffer still has to be destroyed.
+        void (*copy)(void *to, const void *from);
+        void (*move)(void *to, void *from);
+        void (*destroy)(void *buffer);
+        const std::type_info &type;
+    };
+
+    template<typename T>
+    static constexpr bool isInline()
+    {
+        return sizeof(T) <= InlineSize && alignof(void *) % alignof(T) == 0
+               && std::is_nothrow_move_constructible<T>::value;
+    }
+
+    template<typename T>
+    static std::enable_if_t<isInline<T>()> construct(void *buffer, const T &value)
+    {
+        new (buffer) T(value);
+    }
+
+    template<typename T>
+    static std::enable_if_t<!isInline<T>()> construct(void *buffer, const T &value)
+    {
+        *static_cast<T **>(buffer) = new T(value);
+    }
+
+    template<typename T>
+    static std::enable_if_t<isInline<T>(), const T *> get(const void *buffer)
+    {
+        return static_cast<const T *>(buffer);
+    }
+
+    template<typename T>
+    static std::enable_if_t<!isInline<T>(), const T *> get(const void *buffer)
+    {
+        return *static_cast<T *const *>(buffer);
+    }
+
+    template<typename T>
+    static void copy(void *to, const void *from)
+    {
+        construct(to, *get<T>(from));
+    }
+
+    template<typename T>
+    static std::enable_if_t<isInline<T>()> move(void *to, void *from)
+    {
+        new (to) T(std::move(*static_cast<T *>(from)));
+    }
+
+    template<typename T>
+    static std::enable_if_t<!isInline<T>()> move(void *to, void *from)
+    {
+        *static_cast<T **>(to) = *static_cast<T **>(from);
+        *static_cast<T **>(from) = nullptr;
+    }
+
+    template<typename T>
+    static std::enable_if_t<isInline<T>()> destroy(void *buffer)
+    {
+        static_cast<T *>(buffer)->~T();
+    }
+
+    template<typename T>
+    static std::enable_if_t<!isInline<T>()> destroy(void *buffer)
+    {
+        delete *static_cast<T **>(buffer);
+    }
+
+    template<typename T>
+    static constexpr Ops ops = { &copy<T>, &move<T>, &destroy<T>, typeid(T) };
+
+    const Ops *mOps;
+    alignas(void *) char mBuffer[InlineSize];
+};
+
+/**
+ * Values of an execution, at most one per type, see ExecutionValues.
+ */
+class ValueSlots : public QSharedData
+{
+public:
+    template<typename T>
+    const T *get() const
+    {
+        for (const auto &entry : entries) {
+            if (entry.holds<T>()) {
+                return &entry.value<T>();
             }
         }
-        return false;
+        return nullptr;
+    }
+
+    template<typename T>
+    void set(const T &value)
+    {
+        for (auto it = entries.begin(); it != entries.end(); ++it) {
+            if (it->holds<T>()) {
+                entries.erase(it);
+                break;
+            }
+        }
+        entries.emplace_back(value);
+    }
+
+    std::vector<ContextEntry> entries;
+};
+
+class KASYNC_EXPORT ExecutionContext : private InstanceCounter<TrackedObject::ExecutionContext> {
+    friend class ExecutionGuard;
+
+public:
+    using Ptr = QSharedPointer<ExecutionContext>;
+
+    /**
+     * Makes the context of the step being run on this thread available
+     * through current(). A null @p context hides the context of an outer
+     * step.
+     */
+    class KASYNC_EXPORT Scope
+    {
+    public:
+        explicit Scope(const Ptr *context);
+        ~Scope();
+
+    private:
+        const Ptr *mPrevious;
+    };
+
+    ~ExecutionContext();
+
+    /**
+     * Cancels the execution of @p context as soon as the object of @p guard
+     * is destroyed.
+     */
+    static void addGuard(const Ptr &context, ExecutionGuard &guard);
+
+    /**
+     * Cancels the execution of @p context, which runs a nested job, together
+     * with the execution of @p parent.
+     */
+    static void setParent(const Ptr &context, const Ptr &parent);
+
+    /**
+     * Context of the step being run on this thread, if any.
+     */
+    static const Ptr &current();
+
+    /**
+     * Creates the context of a job that the step being run on this thread
+     * starts as part of its work. The job sees the values of the execution
+     * and is cancelled together with it.
+     */
+    static Ptr createNested();
+
+    /**
+     * Whether a guard of the execution was destroyed. The remaining steps are
+     * then skipped.
+     */
+    bool guardIsBroken() const
+    {
+        return mCancelled.load(std::memory_order_acquire);
     }
+
+    /**
+     * Whether the execution has guards and can thus be cancelled.
+     */
+    bool isCancellable() const
+    {
+        return mCancellable;
+    }
+
+    /**
+     * Registers @p callback to be called when the execution is cancelled,
+     * allowing a pending step to finish right away. Returns an id for
+     * removeCancelHook(), or 0 if the execution cannot be cancelled, in
+     * which case the callback is dropped.
+     *
+     * The hooks may be added and removed from any thread, they are called
+     * from the thread that destroys the guard.
+     */
+    int addCancelHook(std::function<void()> callback);
+    void removeCancelHook(int id);
+
+    // Input of the first step, only set while Job::exec() starts the
+    // execution. The first step always runs right away.
+    void *firstIn = nullptr;
+    QSharedDataPointer<ValueSlots> values; // only read, through constData()
+    IntrusivePtr<ExecutionPool> pool; // only set for the executions of a PreparedJob
+    QPointer<const QObject> firstGuard; // owner shown in the execution profile
+    ExecutionProfilePtr profile;
+    int profileParent = -1;
+
+private:
+    void cancel();
+
+    std::atomic<bool> mCancelled{false};
+    bool mCancellable = false;
+    // Protects the cancel hooks and the children, which are also accessed
+    // from the thread that destroys a guard
+    QMutex mMutex;
+    QVector<QPair<int, std::function<void()>>> mCancelHooks;
+    int mLastCancelHook = 0;
+    Ptr mParent;
+    QVector<QWeakPointer<ExecutionContext>> mChildren;
+};
+
+/**
+ * An object guarding a step, see Job::guard().
+ *
+ * Created once per guarded step, it connects to the destroyed() signal of the
+ * object once and cancels the executions of the step that are running at
+ * that time, rather than connecting for each execution.
+ */
+class KASYNC_EXPORT ExecutionGuard
+{
+public:
+    using Ptr = QSharedPointer<ExecutionGuard>;
+
+    static Ptr create(const QObject *object);
+    ~ExecutionGuard();
+
+    ExecutionGuard(const ExecutionGuard &) = delete;
+    ExecutionGuard &operator=(const ExecutionGuard &) = delete;
+
+    /**
+     * Cancels the execution of @p context when the object is destroyed, or
+     * right away if it already is.
+     */
+    void addContext(const ExecutionContext::Ptr &context);
+
+    QPointer<const QObject> object;
+
+private:
+    ExecutionGuard(const QObject *object);
+    void cancel();
+
+    QMutex mMutex;
+    // Contexts that have finished are only pruned once the vector has doubled
+    // in size, so that adding a context stays cheap
+    QVector<QWeakPointer<ExecutionContext>> mContexts;
+    int mPruneAt = 8;
+    QMetaObject::Connection mConnection;
 };
 
 } // namespace Private
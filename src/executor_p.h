@@ -12,6 +12,11 @@
 #include "execution_p.h"
 #include "continuations_p.h"
 #include "debug.h"
+#include "metrics.h"
+#include "introspection.h"
+
+#include <typeinfo>
+#include <vector>
 
 namespace KAsync {
 
@@ -31,10 +36,26 @@ class Tracer;
 
 namespace Private {
 
-class ExecutorBase;
-using ExecutorBasePtr = QSharedPointer<ExecutorBase>;
+/**
+ * State shared by the steps run by ExecutorBase::execSync(), either for
+ * Job::execSync() or for the steps fused into an asynchronous execution.
+ */
+struct SyncExecution
+{
+    const void *firstIn = nullptr; // input of the first step, if any
+    const ExecutorBase *last = nullptr;
+    bool guarded = false;
+
+    // Only set when running fused steps
+    const ExecutionContext *context = nullptr;
+    const ExecutorBase *boundary = nullptr; // last step that was not fused
+    FutureBase *boundaryResult = nullptr;
 
-class ExecutorBase
+    inline bool guardIsBroken() const;
+};
+
+class ExecutorBase : public RefCounted
+                   , private InstanceCounter<TrackedObject::Executor>
 {
     template<typename Out, typename ... In>
     friend class Executor;
@@ -43,6 +64,7 @@ class ExecutorBase
     friend class KAsync::Job;
 
     friend struct Execution;
+    friend struct SyncExecution;
     friend class KAsync::Tracer;
 
 public:
@@ -50,7 +72,85 @@ public:
 
     virtual ExecutionPtr exec(const ExecutorBasePtr &self, QSharedPointer<Private::ExecutionContext> context) = 0;
 
+    /**
+     * Runs the chain up to this step on the stack of the calling thread and
+     * stores the outcome in @p result, which is a Result of the output type
+     * of this step, or a Result<void> if @p discardValue is set. Must only
+     * be called if prepareSync() succeeded, or for steps that are fusible.
+     */
+    virtual void execSync(void *result, bool discardValue, const SyncExecution &sync) = 0;
+
+    /**
+     * Whether the continuation of this step is synchronous.
+     */
+    virtual bool isSynchronous() const = 0;
+
+    /**
+     * Checks that all steps up to this one are synchronous and prepares
+     * @p sync for running them with execSync().
+     */
+    bool prepareSync(SyncExecution &sync) const
+    {
+        sync.last = this;
+        for (const ExecutorBase *executor = this; executor; executor = executor->mPrev.data()) {
+            if (!executor->isSynchronous()) {
+                return false;
+            }
+            sync.guarded |= executor->hasOwnGuards();
+        }
+        return true;
+    }
+
+    /**
+     * Whether any step up to this one has a guard.
+     */
+    bool hasGuards() const
+    {
+        for (const ExecutorBase *executor = this; executor; executor = executor->mPrev.data()) {
+            if (executor->hasOwnGuards()) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * Whether the step can be run as part of the step following it, without
+     * an Execution of its own. This is the case for synchronous steps that
+     * are neither named nor guarded, as there is nothing to observe between
+     * such a step and the next one.
+     */
+    bool isFusible() const
+    {
+        return !mLabel && !hasOwnGuards() && isSynchronous();
+    }
+
+    /**
+     * Name of the step as given by Job::named(), or the mangled type name.
+     */
+    const char *stepName() const
+    {
+        return mLabel ? stepLabelName(mLabel) : typeid(*this).name();
+    }
+
 protected:
+    // Like ExecutionContext::guardIsBroken(), for the guards of all steps
+    // up to this one
+    bool guardIsBroken() const
+    {
+        for (const ExecutorBase *executor = this; executor; executor = executor->mPrev.data()) {
+            if (!executor->mExtension) {
+                continue;
+            }
+            for (const auto &g : executor->mExtension->guards) {
+                if (!g->object) {
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
     ExecutorBase(const ExecutorBasePtr &parent)
         : mPrev(parent)
     {}
@@ -58,7 +158,10 @@ protected:
     template<typename T>
     KAsync::Future<T>* createFuture(const ExecutionPtr &execution) const
     {
-        return new KAsync::Future<T>(execution);
+        static_assert(sizeof(KAsync::Future<T>) == sizeof(FutureBase)
+                      && alignof(KAsync::Future<T>) == alignof(FutureBase),
+                      "Future<T> must fit into Execution::futureStorage");
+        return new (execution->futureStorage) KAsync::Future<T>(execution.data());
     }
 
     void prepend(const ExecutorBasePtr &e)
@@ -70,22 +173,67 @@ protected:
         }
     }
 
-    void addToContext(const QVariant &entry)
+    template<typename T>
+    void addToContext(const T &value)
     {
-        mContext.push_back(entry);
+        extension().context.emplace_back(value);
     }
 
     void guard(const QObject *o)
     {
-        mGuards.push_back(QPointer<const QObject>{o});
+        extension().guards.push_back(ExecutionGuard::create(o));
+    }
+
+    void setLabel(StepLabel *label)
+    {
+        mLabel = label;
+    }
+
+    bool hasOwnGuards() const
+    {
+        return mExtension && !mExtension->guards.isEmpty();
     }
 
-    QString mExecutorName;
-    QVector<QVariant> mContext;
-    QVector<QPointer<const QObject>> mGuards;
+    // Fields that only few steps use, allocated when first needed
+    struct Extension {
+        std::vector<ContextEntry> context;
+        QVector<ExecutionGuard::Ptr> guards;
+    };
+
+    Extension &extension()
+    {
+        if (!mExtension) {
+            mExtension = std::make_unique<Extension>();
+        }
+        return *mExtension;
+    }
+
+    std::unique_ptr<Extension> mExtension;
+    StepLabel *mLabel = nullptr;
     ExecutorBasePtr mPrev;
 };
 
+Execution::Execution(const ExecutorBasePtr &executor)
+    : executor(executor)
+{}
+
+Execution::~Execution()
+{
+    if (resultBase) {
+        resultBase->releaseExecution();
+        resultBase->~FutureBase();
+    }
+    prevExecution.reset();
+}
+
+bool SyncExecution::guardIsBroken() const
+{
+    if (context) {
+        return context->guardIsBroken();
+    }
+    return guarded && last->guardIsBroken();
+}
+
 template<typename Out, typename ... In>
 class Executor : public ExecutorBase
 {
@@ -98,46 +246,34 @@ public:
         , mContinuationHolder(std::move(workerHelper))
         , executionFlag(executionFlag)
     {
-        STORE_EXECUTOR_NAME("Executor", Out, In ...);
     }
 
     virtual ~Executor() = default;
 
-    void run(const ExecutionPtr &execution)
+    void run(const ExecutionPtr &execution, const ExecutionContext::Ptr &context, const Error &error, In && ... input)
     {
-        KAsync::Future<PrevOut> *prevFuture = nullptr;
-        if (execution->prevExecution) {
-            prevFuture = execution->prevExecution->result<PrevOut>();
-            assert(prevFuture->isFinished());
-        }
-
         //Execute one of the available workers
         KAsync::Future<Out> *future = execution->result<Out>();
 
         const auto &continuation = Executor<Out, In ...>::mContinuationHolder;
         if (continuationIs<AsyncContinuation<Out, In ...>>(continuation)) {
-            continuationGet<AsyncContinuation<Out, In ...>>(continuation)(prevFuture ? prevFuture->value() : In() ..., *future);
+            continuationGet<AsyncContinuation<Out, In ...>>(continuation)(std::forward<In>(input) ..., *future);
         } else if (continuationIs<AsyncErrorContinuation<Out, In ...>>(continuation)) {
-            continuationGet<AsyncErrorContinuation<Out, In ...>>(continuation)(
-                    prevFuture->hasError() ? prevFuture->errors().first() : Error(),
-                    prevFuture ? prevFuture->value() : In() ..., *future);
+            continuationGet<AsyncErrorContinuation<Out, In ...>>(continuation)(error, std::forward<In>(input) ..., *future);
         } else if (continuationIs<SyncContinuation<Out, In ...>>(continuation)) {
-            callAndApply(prevFuture ? prevFuture->value() : In() ...,
+            callAndApply(std::forward<In>(input) ...,
                          continuationGet<SyncContinuation<Out, In ...>>(continuation), *future, std::is_void<Out>());
             future->setFinished();
         } else if (continuationIs<SyncErrorContinuation<Out, In ...>>(continuation)) {
-            assert(prevFuture);
-            callAndApply(prevFuture->hasError() ? prevFuture->errors().first() : Error(),
-                         prevFuture ? prevFuture->value() : In() ...,
+            callAndApply(error, std::forward<In>(input) ...,
                          continuationGet<SyncErrorContinuation<Out, In ...>>(continuation), *future, std::is_void<Out>());
             future->setFinished();
         } else if (continuationIs<JobContinuation<Out, In ...>>(continuation)) {
-            executeJobAndApply(prevFuture ? prevFuture->value() : In() ...,
-                               continuationGet<JobContinuation<Out, In ...>>(continuation), *future, std::is_void<Out>());
+            executeJobAndApply(std::forward<In>(input) ...,
+                               continuationGet<JobContinuation<Out, In ...>>(continuation), *future, context);
         } else if (continuationIs<JobErrorContinuation<Out, In ...>>(continuation)) {
-            executeJobAndApply(prevFuture->hasError() ? prevFuture->errors().first() : Error(),
-                               prevFuture ? prevFuture->value() : In() ...,
-                               continuationGet<JobErrorContinuation<Out, In ...>>(continuation), *future, std::is_void<Out>());
+            executeJobAndApply(error, std::forward<In>(input) ...,
+                               continuationGet<JobErrorContinuation<Out, In ...>>(continuation), *future, context);
         }
 
     }
@@ -155,30 +291,41 @@ public:
 
         // Passing 'self' to execution ensures that the Executor chain remains
         // valid until the entire execution is finished
-        ExecutionPtr execution = ExecutionPtr::create(self);
-#ifndef QT_NO_DEBUG
-        execution->tracer = std::make_unique<Tracer>(execution.data()); // owned by execution
-#endif
+        ExecutionPtr execution(new (context->pool.data()) Execution(self));
+        if (Q_UNLIKELY(Tracer::isEnabled())) {
+            execution->tracer = std::make_unique<Tracer>(execution.data()); // owned by execution
+        }
 
-        context->guards += mGuards;
+        if (hasOwnGuards()) {
+            for (const auto &guard : mExtension->guards) {
+                ExecutionContext::addGuard(context, *guard);
+            }
+        }
 
-        // chainup
-        execution->prevExecution = mPrev ? mPrev->exec(mPrev, context) : ExecutionPtr();
+        // chainup, skipping the predecessors that are fused into this step.
+        // Fusing is skipped while tracing or profiling, to keep every step
+        // visible there.
+        const ExecutorBasePtr *prev = &mPrev;
+        if (Q_LIKELY(!Tracer::isEnabled() && !context->profile)) {
+            while (*prev && (*prev)->isFusible()) {
+                prev = &(*prev)->mPrev;
+            }
+        }
+        execution->prevExecution = *prev ? (*prev)->exec(*prev, context) : ExecutionPtr();
+
+        if (Q_UNLIKELY(context->profile)) {
+            execution->profile = context->profile;
+            execution->profileStep = context->profile->addStep(stepName(), context->profileParent,
+                    execution->prevExecution ? execution->prevExecution->profileStep : -1);
+        }
 
         execution->resultBase = ExecutorBase::createFuture<Out>(execution);
-        //We watch our own future to finish the execution once we're done
-        auto fw = new KAsync::FutureWatcher<Out>();
-        QObject::connect(fw, &KAsync::FutureWatcher<Out>::futureReady,
-                         [fw, execution]() {
-                             execution->setFinished();
-                             delete fw;
-                         });
-        fw->setFuture(*execution->result<Out>());
 
         KAsync::Future<PrevOut> *prevFuture = execution->prevExecution ? execution->prevExecution->result<PrevOut>()
                                                                        : nullptr;
         if (!prevFuture || prevFuture->isFinished()) { //The previous job is already done
-            runExecution(prevFuture, execution, context->guardIsBroken());
+            runExecution(prevFuture, execution, context);
+            completeExecution(execution);
         } else { //The previous job is still running and we have to wait for it's completion
             auto prevFutureWatcher = new KAsync::FutureWatcher<PrevOut>();
             QObject::connect(prevFutureWatcher, &KAsync::FutureWatcher<PrevOut>::futureReady,
@@ -186,7 +333,8 @@ public:
                                  auto prevFuture = prevFutureWatcher->future();
                                  assert(prevFuture.isFinished());
                                  delete prevFutureWatcher;
-                                 runExecution(&prevFuture, execution, context->guardIsBroken());
+                                 runExecution(&prevFuture, execution, context);
+                                 completeExecution(execution);
                              });
 
             prevFutureWatcher->setFuture(*static_cast<KAsync::Future<PrevOut>*>(prevFuture));
@@ -195,13 +343,136 @@ public:
         return execution;
     }
 
+    void execSync(void *result, bool discardValue, const SyncExecution &sync) override
+    {
+        if (!std::is_void<Out>::value && discardValue) {
+            Result<Out> value;
+            execSync(value, sync);
+            if (value.hasError()) {
+                *static_cast<Result<void> *>(result) = value.error();
+            }
+        } else {
+            execSync(*static_cast<Result<Out> *>(result), sync);
+        }
+    }
+
+    bool isSynchronous() const override
+    {
+        return continuationIs<SyncContinuation<Out, In ...>>(mContinuationHolder)
+               || continuationIs<SyncErrorContinuation<Out, In ...>>(mContinuationHolder);
+    }
+
 private:
-    void runExecution(const KAsync::Future<PrevOut> *prevFuture, const ExecutionPtr &execution, bool guardIsBroken)
+    void execSync(Result<Out> &result, const SyncExecution &sync)
+    {
+        Result<PrevOut> prev;
+        if (!mPrev) {
+            takeFirstInput(prev, sync.firstIn);
+        } else if (mPrev.data() == sync.boundary) {
+            takeBoundaryResult(prev, static_cast<KAsync::Future<PrevOut> *>(sync.boundaryResult));
+        } else {
+            mPrev->execSync(&prev, std::is_void<PrevOut>::value, sync);
+        }
+
+        if (sync.guardIsBroken()) {
+            return;
+        }
+        if (prev.hasError() && executionFlag == ExecutionFlag::GoodCase) {
+            result = prev.error();
+            return;
+        }
+        if (!prev.hasError() && executionFlag == ExecutionFlag::ErrorCase) {
+            passOnValue(prev, result);
+            return;
+        }
+        if (Q_UNLIKELY(mLabel && Metrics::isEnabled())) {
+            const qint64 cpuStart = threadCpuTime();
+            const qint64 start = monotonicTime();
+            runSync(prev, result);
+            recordStep(mLabel, monotonicTime() - start, threadCpuTime() - cpuStart, result.hasError());
+        } else {
+            runSync(prev, result);
+        }
+    }
+
+    void runSync(Result<PrevOut> &prev, Result<Out> &result)
+    {
+        // The result of the previous step is not needed afterwards, so its
+        // value can be moved into the continuation
+        const auto &continuation = mContinuationHolder;
+        if (continuationIs<SyncContinuation<Out, In ...>>(continuation)) {
+            callAndApply(static_cast<In &&>(prev.value()) ...,
+                         continuationGet<SyncContinuation<Out, In ...>>(continuation), result, std::is_void<Out>());
+        } else {
+            callAndApply(prev.error(), static_cast<In &&>(prev.value()) ...,
+                         continuationGet<SyncErrorContinuation<Out, In ...>>(continuation), result, std::is_void<Out>());
+        }
+    }
+
+    // Synchronous steps have already finished their Future when run()
+    // returns, only the others need to be watched until they finish.
+    void completeExecution(const ExecutionPtr &execution)
+    {
+        // Only the executor chain needs to stay alive, the previous execution
+        // and its result are not needed anymore. This may happen while the
+        // Future of the previous execution is still notifying its watchers,
+        // which keeps its shared data alive.
+        execution->prevExecution.reset();
+        if (execution->resultBase->isFinished()) {
+            finishExecution(execution);
+            return;
+        }
+        // The hook holds a reference to keep the execution alive until it is
+        // finished. Hooks are called before the watchers of the Future, so
+        // the step is recorded as finished before the next step runs.
+        execution->ref();
+        execution->finishedHook.callback = &Executor::asyncStepFinished;
+        execution->finishedHook.execution = execution.data();
+        if (!execution->resultBase->addFinishedHook(&execution->finishedHook)) {
+            // Finished on another thread meanwhile
+            execution->deref();
+            finishExecution(execution);
+        }
+    }
+
+    static void asyncStepFinished(Private::FinishedHook *hook)
+    {
+        const ExecutionPtr execution(static_cast<Execution::FinishedHook *>(hook)->execution);
+        execution->deref(); // the reference taken by completeExecution()
+        static_cast<Executor *>(execution->executor.data())->finishExecution(execution);
+    }
+
+    void finishExecution(const ExecutionPtr &execution)
+    {
+        const bool error = execution->resultBase->hasError();
+        if (execution->runStart) {
+            recordStep(mLabel, monotonicTime() - execution->runStart, execution->cpuTime, error);
+        }
+        if (execution->profile) {
+            execution->profile->stepFinished(execution->profileStep, error);
+        }
+        execution->setFinished();
+    }
+
+    bool isFused(const ExecutionPtr &execution) const
+    {
+        return mPrev && (!execution->prevExecution || execution->prevExecution->executor != mPrev);
+    }
+
+    // The result of the previous step is consumed by this step, so its value
+    // is moved out rather than copied.
+    void runExecution(KAsync::Future<PrevOut> *prevFuture, const ExecutionPtr &execution,
+                      const ExecutionContext::Ptr &context)
     {
-        if (guardIsBroken) {
+        if (context->guardIsBroken()) {
             execution->resultBase->setFinished();
             return;
         }
+        const ExecutionContext::Scope scope(&context);
+        if (isFused(execution)) {
+            runFused(execution, context);
+            return;
+        }
         if (prevFuture) {
             if (prevFuture->hasError() && executionFlag == ExecutionFlag::GoodCase) {
                 //Propagate the error to the outer Future
@@ -211,70 +482,137 @@ private:
             }
             if (!prevFuture->hasError() && executionFlag == ExecutionFlag::ErrorCase) {
                 //Propagate the value to the outer Future
-                copyFutureValue<PrevOut>(*prevFuture, *execution->result<PrevOut>());
+                moveFutureValue<PrevOut>(*prevFuture, *execution->result<PrevOut>());
                 execution->resultBase->setFinished();
                 return;
             }
         }
-        run(execution);
+        invoke(execution, [&]() {
+            run(execution, context, prevFuture && prevFuture->hasError() ? prevFuture->errors().first() : Error(),
+                prevFuture ? static_cast<In &&>(**prevFuture) : firstInput<In>(*context) ...);
+        });
     }
 
-    void executeJobAndApply(In && ... input, const JobContinuation<Out, In ...> &func,
-                            Future<Out> &future, std::false_type)
-    {
-        func(std::forward<In>(input) ...)
-            .template then<void, Out>([&future](const KAsync::Error &error, const Out &v,
-                                                KAsync::Future<void> &f) {
-                if (error) {
-                    future.setError(error);
-                } else {
-                    future.setResult(v);
-                }
-                f.setFinished();
-            }).exec();
+    // Runs the synchronous predecessors fused into this step, then this
+    // step on their result
+    void runFused(const ExecutionPtr &execution, const ExecutionContext::Ptr &context)
+    {
+        SyncExecution sync;
+        sync.firstIn = context->firstIn;
+        sync.context = context.data();
+        if (execution->prevExecution) {
+            sync.boundary = execution->prevExecution->executor.data();
+            sync.boundaryResult = execution->prevExecution->resultBase;
+        }
+        Result<PrevOut> input;
+        mPrev->execSync(&input, std::is_void<PrevOut>::value, sync);
+
+        if (context->guardIsBroken()) {
+            execution->resultBase->setFinished();
+            return;
+        }
+        if (input.hasError() && executionFlag == ExecutionFlag::GoodCase) {
+            execution->resultBase->setError(input.error());
+            return;
+        }
+        if (!input.hasError() && executionFlag == ExecutionFlag::ErrorCase) {
+            passOnValue(input, *execution->result<Out>());
+            execution->resultBase->setFinished();
+            return;
+        }
+        invoke(execution, [&]() {
+            run(execution, context, input.error(), static_cast<In &&>(input.value()) ...);
+        });
+    }
+
+    template<typename F>
+    void invoke(const ExecutionPtr &execution, F &&f)
+    {
+        if (execution->tracer) {
+            execution->tracer->step();
+        }
+        ProfileScope profileScope(execution->profile, execution->profileStep);
+        if (Q_UNLIKELY(mLabel && Metrics::isEnabled())) {
+            const qint64 cpuStart = threadCpuTime();
+            execution->runStart = monotonicTime();
+            f();
+            execution->cpuTime = threadCpuTime() - cpuStart;
+        } else {
+            f();
+        }
     }
 
     void executeJobAndApply(In && ... input, const JobContinuation<Out, In ...> &func,
-                            Future<Out> &future, std::true_type)
-    {
-        func(std::forward<In>(input) ...)
-            .template then<void>([&future](const KAsync::Error &error, KAsync::Future<void> &f) {
-                if (error) {
-                    future.setError(error);
-                } else {
-                    future.setFinished();
-                }
-                f.setFinished();
-            }).exec();
+                            Future<Out> &future, const ExecutionContext::Ptr &context)
+    {
+        applyNested(execNested(func(std::forward<In>(input) ...), context), future);
     }
 
     void executeJobAndApply(const Error &error, In && ... input, const JobErrorContinuation<Out, In ...> &func,
-                            Future<Out> &future, std::false_type)
-    {
-        func(error, std::forward<In>(input) ...)
-            .template then<void, Out>([&future](const KAsync::Error &error, const Out &v,
-                                                KAsync::Future<void> &f) {
-                if (error) {
-                    future.setError(error);
-                } else {
-                    future.setResult(v);
-                }
-                f.setFinished();
-            }).exec();
+                            Future<Out> &future, const ExecutionContext::Ptr &context)
+    {
+        applyNested(execNested(func(error, std::forward<In>(input) ...), context), future);
     }
 
-    void executeJobAndApply(const Error &error, In && ... input, const JobErrorContinuation<Out, In ...> &func,
-                            Future<Out> &future, std::true_type)
-    {
-        func(error, std::forward<In>(input) ...)
-            .template then<void>([&future](const KAsync::Error &error, KAsync::Future<void> &f) {
-                if (error) {
-                    future.setError(error);
-                } else {
-                    future.setFinished();
-                }
-                f.setFinished();
-            }).exec();
+    /*
+     * Executes the job returned by a continuation as part of the running
+     * execution, sharing its context. A job with guards of its own gets a
+     * child context instead, so that its guards only apply to its own steps
+     * while the guards of the running execution still cancel it. While
+     * profiling, the job gets its own context as well, which shows its steps
+     * below the step that returned it.
+     */
+    static ExecutionPtr execNested(const Job<Out> &job, const ExecutionContext::Ptr &context)
+    {
+        const ExecutorBasePtr &executor = job.mExecutor;
+        if (Q_LIKELY(!context->profile && !executor->hasGuards())) {
+            return executor->exec(executor, context);
+        }
+        auto nested = ExecutionContext::Ptr::create();
+        ExecutionContext::setParent(nested, context);
+        nested->values = context->values;
+        nested->pool = context->pool;
+        if (context->profile) {
+            ExecutionProfile::attach(*nested);
+        }
+        return executor->exec(executor, nested);
+    }
+
+    // Finishes the future of this step with the result of the nested job
+    static void applyNested(const ExecutionPtr &nested, Future<Out> &future)
+    {
+        KAsync::Future<Out> *nestedFuture = nested->result<Out>();
+        if (nestedFuture->isFinished()) {
+            moveResult(*nestedFuture, future);
+            return;
+        }
+        auto fw = new KAsync::FutureWatcher<Out>();
+        QObject::connect(fw, &KAsync::FutureWatcher<Out>::futureReady,
+                         [fw, nested, &future]() {
+                             moveResult(*nested->result<Out>(), future);
+                             delete fw;
+                         });
+        fw->setFuture(*nestedFuture);
+    }
+
+    template<typename T>
+    static void moveResult(KAsync::Future<T> &from, KAsync::Future<T> &to)
+    {
+        if (from.hasError()) {
+            to.setError(from.errors().first());
+        } else {
+            *to = std::move(*from);
+            to.setFinished();
+        }
+    }
+
+    static void moveResult(KAsync::Future<void> &from, KAsync::Future<void> &to)
+    {
+        if (from.hasError()) {
+            to.setError(from.errors().first());
+        } else {
+            to.setFinished();
+        }
     }
 
     void callAndApply(In && ... input, const SyncContinuation<Out, In ...> &func, Future<Out> &future, std::false_type)
@@ -297,16 +635,104 @@ private:
         func(error, std::forward<In>(input) ...);
     }
 
+    void callAndApply(In && ... input, const SyncContinuation<Out, In ...> &func, Result<Out> &result, std::false_type)
+    {
+        result = func(std::forward<In>(input) ...);
+    }
+
+    void callAndApply(In && ... input, const SyncContinuation<Out, In ...> &func, Result<Out> &, std::true_type)
+    {
+        func(std::forward<In>(input) ...);
+    }
+
+    void callAndApply(const Error &error, In && ... input, const SyncErrorContinuation<Out, In ...> &func, Result<Out> &result, std::false_type)
+    {
+        result = func(error, std::forward<In>(input) ...);
+    }
+
+    void callAndApply(const Error &error, In && ... input, const SyncErrorContinuation<Out, In ...> &func, Result<Out> &, std::true_type)
+    {
+        func(error, std::forward<In>(input) ...);
+    }
+
+    // The first step takes its input from the context, and may move it as
+    // nothing else uses it
     template<typename T>
-    std::enable_if_t<!std::is_void<T>::value>
-    copyFutureValue(const KAsync::Future<T> &in, KAsync::Future<T> &out)
+    static T firstInput(const ExecutionContext &context)
+    {
+        return context.firstIn ? std::move(*static_cast<T *>(context.firstIn)) : T();
+    }
+
+    template<typename T>
+    static std::enable_if_t<!std::is_void<T>::value>
+    takeFirstInput(Result<T> &in, const void *firstIn)
+    {
+        if (firstIn) {
+            in.value() = *static_cast<const T *>(firstIn);
+        }
+    }
+
+    template<typename T>
+    static std::enable_if_t<std::is_void<T>::value>
+    takeFirstInput(Result<T> &, const void *)
+    {
+    }
+
+    template<typename T>
+    static void takeBoundaryResult(Result<T> &in, KAsync::Future<T> *future)
+    {
+        if (future->hasError()) {
+            in = future->errors().first();
+        } else {
+            in.value() = std::move(**future);
+        }
+    }
+
+    static void takeBoundaryResult(Result<void> &in, KAsync::Future<void> *future)
+    {
+        if (future->hasError()) {
+            in = future->errors().first();
+        }
+    }
+
+    // Steps that pass on the value of the previous step (ErrorCase) have the
+    // same input and output type, the overload for different types is never
+    // called.
+    template<typename T>
+    static void passOnValue(Result<T> &in, Result<T> &out)
+    {
+        out.value() = std::move(in.value());
+    }
+
+    template<typename T>
+    static void passOnValue(Result<T> &in, KAsync::Future<T> &out)
     {
         out.setValue(in.value());
     }
 
+    static void passOnValue(Result<void> &, Result<void> &)
+    {
+    }
+
+    static void passOnValue(Result<void> &, KAsync::Future<void> &)
+    {
+    }
+
+    template<typename T, typename U>
+    static void passOnValue(Result<T> &, U &)
+    {
+    }
+
+    template<typename T>
+    std::enable_if_t<!std::is_void<T>::value>
+    moveFutureValue(KAsync::Future<T> &in, KAsync::Future<T> &out)
+    {
+        *out = std::move(*in);
+    }
+
     template<typename T>
     std::enable_if_t<std::is_void<T>::value>
-    copyFutureValue(const KAsync::Future<T> &, KAsync::Future<T> &)
+    moveFutureValue(KAsync::Future<T> &, KAsync::Future<T> &)
     {
         //noop
     }
@@ -7,15 +7,28 @@
 #include "future.h"
 #include "async.h"
 
+#include <utility>
+
 using namespace KAsync;
 
+namespace {
+
+// Marks the hooks of a finished Future, no hook can be added anymore
+Private::FinishedHook *finishedHooks()
+{
+    static Private::FinishedHook sentinel;
+    return &sentinel;
+}
+
+}
+
 QDebug &operator<<(QDebug &dbg, const Error &error)
 {
     dbg << "Error: " << error.errorCode << "Msg: " << error.errorMessage;
     return dbg;
 }
 
-FutureBase::PrivateBase::PrivateBase(const Private::ExecutionPtr &execution)
+FutureBase::PrivateBase::PrivateBase(Private::Execution *execution)
     : finished(false)
     , mExecution(execution)
 {
@@ -23,16 +36,15 @@ FutureBase::PrivateBase::PrivateBase(const Private::ExecutionPtr &execution)
 
 FutureBase::PrivateBase::~PrivateBase()
 {
-    Private::ExecutionPtr executionPtr = mExecution.toStrongRef();
-    if (executionPtr) {
-        executionPtr->releaseFuture();
+    if (mExecution) {
+        mExecution->releaseFuture();
         releaseExecution();
     }
 }
 
 void FutureBase::PrivateBase::releaseExecution()
 {
-    mExecution.clear();
+    mExecution = nullptr;
 }
 
 
@@ -66,9 +78,21 @@ void FutureBase::setFinished()
     if (isFinished()) {
         return;
     }
-    d->finished = true;
-    //TODO this could directly call the next continuation with the value, and thus avoid unnecessary copying.
-    for (auto watcher : d->watchers) {
+    // A watcher may release the execution owning this Future, so the shared
+    // data is kept alive until all watchers are notified.
+    const auto data = d;
+    data->finished = true;
+    auto hook = data->hooks.exchange(finishedHooks(), std::memory_order_acq_rel);
+    if (hook == finishedHooks()) {
+        return; // finished concurrently on another thread
+    }
+    // A hook may release its owner, which holds the next hook as well
+    while (hook) {
+        auto next = hook->next;
+        hook->callback(hook);
+        hook = next;
+    }
+    for (auto watcher : data->watchers) {
         if (watcher) {
             watcher->futureReadyCallback();
         }
@@ -146,6 +170,18 @@ void FutureBase::setProgress(qreal progress)
 
 
 
+bool FutureBase::addFinishedHook(Private::FinishedHook *hook)
+{
+    auto &hooks = d->hooks;
+    hook->next = hooks.load(std::memory_order_acquire);
+    do {
+        if (hook->next == finishedHooks()) {
+            return false;
+        }
+    } while (!hooks.compare_exchange_weak(hook->next, hook, std::memory_order_acq_rel, std::memory_order_acquire));
+    return true;
+}
+
 void FutureBase::addWatcher(FutureWatcherBase* watcher)
 {
     d->watchers.append(QPointer<FutureWatcherBase>(watcher));
@@ -9,9 +9,11 @@
 #define FUTURE_H
 
 #include "kasync_export.h"
+#include "metrics.h"
 
 class QEventLoop;
 
+#include <atomic>
 #include <type_traits>
 
 #include <QSharedDataPointer>
@@ -31,7 +33,15 @@ namespace Private {
 struct Execution;
 class ExecutorBase;
 
-typedef QSharedPointer<Execution> ExecutionPtr;
+/**
+ * Callback of a Future that is called once the Future is finished, see
+ * FutureBase::addFinishedHook().
+ */
+struct FinishedHook
+{
+    void (*callback)(FinishedHook *hook) = nullptr;
+    FinishedHook *next = nullptr;
+};
 } // namespace Private
 
 struct KASYNC_EXPORT Error
@@ -63,6 +73,89 @@ private:
     operator T() const;
 };
 
+/**
+ * @brief Value or error of a job executed with Job::execSync().
+ *
+ * A default constructed Result holds a default constructed value and no
+ * error, which is also the result of a job whose guard is broken.
+ */
+template<typename T>
+class Result
+{
+public:
+    Result() = default;
+
+    Result(const T &value)
+        : mValue(value)
+    {}
+
+    Result(T &&value)
+        : mValue(std::move(value))
+    {}
+
+    Result(const Error &error)
+        : mError(error)
+    {}
+
+    bool hasError() const
+    {
+        return mError.errorCode != 0;
+    }
+
+    Error error() const
+    {
+        return mError;
+    }
+
+    const T &value() const
+    {
+        return mValue;
+    }
+
+    T &value()
+    {
+        return mValue;
+    }
+
+    explicit operator bool() const
+    {
+        return !hasError();
+    }
+
+private:
+    T mValue{};
+    Error mError;
+};
+
+template<>
+class Result<void>
+{
+public:
+    Result() = default;
+
+    Result(const Error &error)
+        : mError(error)
+    {}
+
+    bool hasError() const
+    {
+        return mError.errorCode != 0;
+    }
+
+    Error error() const
+    {
+        return mError;
+    }
+
+    explicit operator bool() const
+    {
+        return !hasError();
+    }
+
+private:
+    Error mError;
+};
+
 class KASYNC_EXPORT FutureBase
 {
     friend struct KAsync::Private::Execution;
@@ -87,11 +180,26 @@ public:
     void setProgress(qreal progress);
     void setProgress(int processed, int total);
 
+    //@cond PRIVATE
+    /**
+     * Calls @p hook once the Future is finished. Returns false, without
+     * adding the hook, if the Future is already finished.
+     *
+     * Unlike a FutureWatcher, the hook needs no allocation and is called
+     * directly. It is owned by the caller and must stay valid until it is
+     * called, or until the Future is gone. Hooks may be added while the
+     * Future is being finished on another thread, they are then called
+     * from that thread.
+     */
+    bool addFinishedHook(KAsync::Private::FinishedHook *hook);
+    //@endcond
+
 protected:
     class KASYNC_EXPORT PrivateBase : public QSharedData
+                                    , private KAsync::Private::InstanceCounter<TrackedObject::FuturePrivate>
     {
     public:
-        explicit PrivateBase(const KAsync::Private::ExecutionPtr &execution);
+        explicit PrivateBase(KAsync::Private::Execution *execution);
         virtual ~PrivateBase();
 
         void releaseExecution();
@@ -100,8 +208,11 @@ protected:
         QVector<Error> errors;
 
         QVector<QPointer<FutureWatcherBase>> watchers;
+        // Set to finishedHooks() once the hooks are called
+        std::atomic<KAsync::Private::FinishedHook *> hooks{nullptr};
     private:
-        QWeakPointer<KAsync::Private::Execution> mExecution;
+        // Cleared by the execution when it is destroyed
+        KAsync::Private::Execution *mExecution;
     };
 
     explicit FutureBase();
@@ -144,7 +255,7 @@ public:
 
 protected:
     //@cond PRIVATE
-    explicit FutureGeneric(const KAsync::Private::ExecutionPtr &execution)
+    explicit FutureGeneric(KAsync::Private::Execution *execution)
         : FutureBase(new Private(execution))
     {}
 
@@ -155,7 +266,7 @@ protected:
     class Private : public FutureBase::PrivateBase
     {
     public:
-        explicit Private(const KAsync::Private::ExecutionPtr &execution)
+        explicit Private(KAsync::Private::Execution *execution)
             : FutureBase::PrivateBase(execution)
         {}
 
@@ -195,7 +306,7 @@ public:
      * @brief Constructor
      */
     explicit Future()
-        : FutureGeneric<T>(KAsync::Private::ExecutionPtr())
+        : FutureGeneric<T>(nullptr)
     {}
 
     /**
@@ -343,7 +454,7 @@ public:
 
 protected:
     //@cond PRIVATE
-    Future(const KAsync::Private::ExecutionPtr &execution)
+    Future(KAsync::Private::Execution *execution)
         : FutureGeneric<T>(execution)
     {}
     //@endcond
@@ -381,12 +492,12 @@ public:
      * @brief Constructor
      */
     Future()
-        : FutureGeneric<void>(KAsync::Private::ExecutionPtr())
+        : FutureGeneric<void>(nullptr)
     {}
 
 protected:
     //@cond PRIVATE
-    Future(const KAsync::Private::ExecutionPtr &execution)
+    Future(KAsync::Private::Execution *execution)
         : FutureGeneric<void>(execution)
     {}
     //@endcond
@@ -397,6 +508,7 @@ protected:
 
 //@cond PRIVATE
 class KASYNC_EXPORT FutureWatcherBase : public QObject
+                                      , private KAsync::Private::InstanceCounter<TrackedObject::FutureWatcher>
 {
     Q_OBJECT
 
@@ -0,0 +1,345 @@
+/*
+    SPDX-FileCopyrightText: 2026 KAsync contributors
+
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#include "introspection.h"
+#include "future.h"
+#include "execution_p.h"
+#include "metrics.h"
+#include "debug.h"
+
+#include <QHash>
+#include <QSet>
+#include <QStringBuilder>
+#include <QTimer>
+
+#include <algorithm>
+
+using namespace KAsync;
+
+namespace {
+
+thread_local Private::ProfileScope *currentProfileScope = nullptr;
+
+QMutex handlerMutex;
+Introspection::SlowExecutionHandler slowExecutionHandler;
+
+QString formatDuration(qint64 nsecs)
+{
+    return QString::number(nsecs / 1000000.0, 'f', 3) % QStringLiteral(" ms");
+}
+
+struct LiveRegistry
+{
+    QMutex mutex;
+    QHash<quint64, Private::ExecutionProfilePtr> executions;
+    quint64 lastId = 0;
+};
+
+LiveRegistry &liveRegistry()
+{
+    static LiveRegistry registry;
+    return registry;
+}
+
+struct Watchdog
+{
+    QTimer timer;
+    qint64 stuckMsecs = 0;
+    qint64 lagMsecs = 0;
+    qint64 lastCheck = 0;
+    QSet<quint64> reported;
+
+    void check();
+};
+
+QMutex watchdogMutex;
+Watchdog *watchdog = nullptr;
+Introspection::WatchdogHandler watchdogHandler;
+
+void reportWatchdog(const QString &report)
+{
+    QMutexLocker locker(&watchdogMutex);
+    if (watchdogHandler) {
+        watchdogHandler(report);
+    } else {
+        qCWarning(Debug).noquote() << report;
+    }
+}
+
+void Watchdog::check()
+{
+    const qint64 now = Private::monotonicTime();
+    const qint64 lag = (now - lastCheck) / 1000000 - timer.interval();
+    lastCheck = now;
+    if (lag > lagMsecs) {
+        reportWatchdog(QStringLiteral("Event loop lag: ") % QString::number(lag) % QStringLiteral(" ms"));
+    }
+
+    QSet<quint64> live;
+    for (const auto &info : Introspection::liveExecutions()) {
+        live.insert(info.id);
+        if (info.age < stuckMsecs || reported.contains(info.id)) {
+            continue;
+        }
+        reported.insert(info.id);
+        QString report = QStringLiteral("Execution ") % QString::number(info.id)
+                         % QStringLiteral(" pending for ") % QString::number(info.age) % QStringLiteral(" ms, current step: ")
+                         % (info.currentStep.isEmpty() ? QStringLiteral("(none)") : info.currentStep);
+        if (info.guard) {
+            report += QStringLiteral(", guard: ") % QString::fromLatin1(info.guard->metaObject()->className())
+                      % QStringLiteral(" '") % info.guard->objectName() % QLatin1Char('\'');
+        }
+        reportWatchdog(report);
+    }
+    // Forget about executions that have finished in the meantime
+    reported.intersect(live);
+}
+
+}
+
+std::atomic<qint64> Introspection::sSlowExecutionThreshold{qEnvironmentVariableIntValue("KASYNC_SLOW_EXECUTION_MSECS")};
+std::atomic<bool> Introspection::sLiveExecutionTracking{false};
+
+void Introspection::setSlowExecutionThreshold(qint64 msecs)
+{
+    sSlowExecutionThreshold.store(qMax<qint64>(msecs, 0), std::memory_order_relaxed);
+}
+
+void Introspection::setSlowExecutionHandler(const SlowExecutionHandler &handler)
+{
+    QMutexLocker locker(&handlerMutex);
+    slowExecutionHandler = handler;
+}
+
+void Introspection::setLiveExecutionTracking(bool enabled)
+{
+    sLiveExecutionTracking.store(enabled, std::memory_order_relaxed);
+}
+
+QVector<ExecutionInfo> Introspection::liveExecutions()
+{
+    QVector<Private::ExecutionProfilePtr> profiles;
+    {
+        auto &registry = liveRegistry();
+        QMutexLocker locker(&registry.mutex);
+        profiles.reserve(registry.executions.size());
+        for (const auto &profile : registry.executions) {
+            profiles.push_back(profile);
+        }
+    }
+
+    const qint64 now = Private::monotonicTime();
+    QVector<ExecutionInfo> result;
+    result.reserve(profiles.size());
+    for (const auto &profile : profiles) {
+        result.push_back(profile->info(now));
+    }
+    std::sort(result.begin(), result.end(), [](const ExecutionInfo &a, const ExecutionInfo &b) {
+        return a.id < b.id;
+    });
+    return result;
+}
+
+void Introspection::startWatchdog(qint64 stuckMsecs, qint64 lagMsecs, qint64 intervalMsecs)
+{
+    setLiveExecutionTracking(true);
+    if (!watchdog) {
+        watchdog = new Watchdog;
+        QObject::connect(&watchdog->timer, &QTimer::timeout, [] {
+            watchdog->check();
+        });
+    }
+    watchdog->stuckMsecs = stuckMsecs;
+    watchdog->lagMsecs = lagMsecs;
+    watchdog->lastCheck = Private::monotonicTime();
+    watchdog->timer.start(static_cast<int>(intervalMsecs));
+}
+
+void Introspection::stopWatchdog()
+{
+    delete watchdog;
+    watchdog = nullptr;
+}
+
+void Introspection::setWatchdogHandler(const WatchdogHandler &handler)
+{
+    QMutexLocker locker(&watchdogMutex);
+    watchdogHandler = handler;
+}
+
+void Private::ExecutionProfile::attach(ExecutionContext &context)
+{
+    if (currentProfileScope) {
+        context.profile = *currentProfileScope->mProfile;
+        context.profileParent = currentProfileScope->mStep;
+        return;
+    }
+
+    context.profile = ExecutionProfilePtr::create();
+    context.profile->mStart = monotonicTime();
+    if (Introspection::isLiveExecutionTrackingEnabled()) {
+        auto &registry = liveRegistry();
+        QMutexLocker locker(&registry.mutex);
+        context.profile->mId = ++registry.lastId;
+        registry.executions.insert(context.profile->mId, context.profile);
+    }
+}
+
+int Private::ExecutionProfile::addStep(const char *name, int parent, int prev)
+{
+    QMutexLocker locker(&mMutex);
+    mSteps.push_back({name, parent, prev, monotonicTime(), 0, 0, false});
+    return static_cast<int>(mSteps.size()) - 1;
+}
+
+void Private::ExecutionProfile::stepStarted(int step)
+{
+    QMutexLocker locker(&mMutex);
+    mSteps[step].runStart = monotonicTime();
+    mCurrentStep = mSteps[step].name;
+}
+
+void Private::ExecutionProfile::stepFinished(int step, bool error)
+{
+    QMutexLocker locker(&mMutex);
+    mSteps[step].finished = monotonicTime();
+    mSteps[step].error = error;
+    if (step == mRoot) {
+        locker.unlock();
+        finish();
+    }
+}
+
+void Private::ExecutionProfile::setRoot(int step, const QPointer<const QObject> &guard)
+{
+    QMutexLocker locker(&mMutex);
+    mRoot = step;
+    mGuard = guard;
+    if (mSteps[step].finished) {
+        locker.unlock();
+        finish();
+    }
+}
+
+void Private::ExecutionProfile::finish()
+{
+    QMutexLocker locker(&mMutex);
+    if (mFinished) {
+        return;
+    }
+    mFinished = true;
+    if (mId) {
+        auto &registry = liveRegistry();
+        QMutexLocker registryLocker(&registry.mutex);
+        registry.executions.remove(mId);
+    }
+
+    const qint64 duration = mSteps[mRoot].finished - mStart;
+    const qint64 threshold = Introspection::slowExecutionThreshold();
+    if (threshold <= 0 || duration < threshold * 1000000) {
+        return;
+    }
+    const QString text = report(duration);
+    locker.unlock();
+
+    QMutexLocker handlerLocker(&handlerMutex);
+    if (slowExecutionHandler) {
+        slowExecutionHandler(text);
+    } else {
+        qCWarning(Debug).noquote() << text;
+    }
+}
+
+QString Private::ExecutionProfile::report(qint64 duration) const
+{
+    const int count = static_cast<int>(mSteps.size());
+
+    // The steps of a chain are executed one after another, so the critical
+    // path follows the chain of the root step back to its start. For every
+    // step on it, the nested job that finished last is on it as well.
+    std::vector<bool> critical(count, false);
+    std::vector<int> pending{mRoot};
+    while (!pending.empty()) {
+        int step = pending.back();
+        pending.pop_back();
+        for (; step >= 0; step = mSteps[step].prev) {
+            critical[step] = true;
+            int last = -1;
+            for (int i = 0; i < count; ++i) {
+                if (mSteps[i].parent == step && (last < 0 || mSteps[i].finished > mSteps[last].finished)) {
+                    last = i;
+                }
+            }
+            if (last >= 0) {
+                pending.push_back(last);
+            }
+        }
+    }
+
+    QString out = QStringLiteral("Slow execution: finished after ") % formatDuration(duration)
+                  % QStringLiteral(" (threshold ") % QString::number(Introspection::slowExecutionThreshold())
+                  % QStringLiteral(" ms)");
+
+    // Steps are added in chain order, so walking them by index lists every
+    // chain from its first step, with nested jobs below their parent step.
+    std::vector<std::pair<int, int>> stack; // step, depth
+    for (int i = count - 1; i >= 0; --i) {
+        if (mSteps[i].parent < 0) {
+            stack.push_back({i, 0});
+        }
+    }
+    while (!stack.empty()) {
+        const auto [index, depth] = stack.back();
+        stack.pop_back();
+        const Step &step = mSteps[index];
+
+        out += QLatin1Char('\n') % QString(depth * 2 + 2, QLatin1Char(' '))
+               % QLatin1Char(critical[index] ? '*' : '-') % QLatin1Char(' ')
+               % demangleName(step.name);
+        if (!step.runStart) {
+            out += QStringLiteral(" [skipped]");
+        } else {
+            const qint64 ready = step.prev >= 0 ? qMax(step.created, mSteps[step.prev].finished) : step.created;
+            out += QStringLiteral(" wait ") % formatDuration(qMax<qint64>(step.runStart - ready, 0))
+                   % QStringLiteral(", run ")
+                   % (step.finished ? formatDuration(step.finished - step.runStart) : QStringLiteral("(pending)"));
+        }
+        if (step.error) {
+            out += QStringLiteral(" [error]");
+        }
+
+        for (int i = count - 1; i > index; --i) {
+            if (mSteps[i].parent == index) {
+                stack.push_back({i, depth + 1});
+            }
+        }
+    }
+    return out;
+}
+
+ExecutionInfo Private::ExecutionProfile::info(qint64 now) const
+{
+    QMutexLocker locker(&mMutex);
+    ExecutionInfo info;
+    info.id = mId;
+    info.age = (now - mStart) / 1000000;
+    info.currentStep = demangleName(mCurrentStep);
+    info.guard = mGuard;
+    return info;
+}
+
+void Private::ProfileScope::enter(int step)
+{
+    mStep = step;
+    mOuter = currentProfileScope;
+    currentProfileScope = this;
+    (*mProfile)->stepStarted(step);
+}
+
+void Private::ProfileScope::leave()
+{
+    currentProfileScope = mOuter;
+}
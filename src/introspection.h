@@ -0,0 +1,238 @@
+/*
+    SPDX-FileCopyrightText: 2026 KAsync contributors
+
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#ifndef KASYNC_INTROSPECTION_H
+#define KASYNC_INTROSPECTION_H
+
+#include "kasync_export.h"
+
+#include <QMutex>
+#include <QPointer>
+#include <QSharedPointer>
+#include <QString>
+#include <QVector>
+
+#include <atomic>
+#include <functional>
+#include <vector>
+
+namespace KAsync {
+
+/**
+ * @brief Snapshot of a top-level execution that has not finished yet.
+ *
+ * @see Introspection::liveExecutions()
+ */
+struct KASYNC_EXPORT ExecutionInfo
+{
+    quint64 id = 0;
+    /** Milliseconds since the execution was started by Job::exec(). */
+    qint64 age = 0;
+    /** The step that was invoked last, empty if no step was invoked yet. */
+    QString currentStep;
+    /** The first guard of the execution, if any. */
+    QPointer<const QObject> guard;
+};
+
+/**
+ * @brief Reports slow and stuck job executions.
+ *
+ * Once a slow execution threshold is set, every top-level Job::exec() is
+ * profiled. If the execution takes longer than the threshold to finish, a
+ * report of the complete execution tree is passed to the slow execution
+ * handler, which by default logs it as a warning.
+ *
+ * The report lists every step of the chain as well as the steps of jobs
+ * that were executed while one of the steps was running (i.e. jobs returned
+ * from a continuation), indented below that step. For each step the time
+ * it spent waiting for its predecessor to finish and the time from its
+ * invocation until its Future finished are shown. Steps on the critical
+ * path are marked with an asterisk, steps that were not invoked due to an
+ * error or a broken guard are shown as skipped.
+ *
+ * Steps named with Job::named() are shown under their name.
+ *
+ * The threshold can also be set from the start in milliseconds using the
+ * KASYNC_SLOW_EXECUTION_MSECS environment variable.
+ *
+ * Once live execution tracking is enabled, all top-level executions started
+ * afterwards are kept in a registry until they finish, so that executions
+ * that never finish (typically because a continuation never finished its
+ * Future) can be listed with liveExecutions(). The watchdog builds on this
+ * and periodically reports executions that are pending for too long, as
+ * well as delays of the event loop it runs in.
+ *
+ * While neither is enabled, the cost is a check of two flags per exec().
+ */
+class KASYNC_EXPORT Introspection
+{
+public:
+    using SlowExecutionHandler = std::function<void(const QString &report)>;
+
+    /**
+     * Sets the threshold in milliseconds. Zero disables the reporting.
+     */
+    static void setSlowExecutionThreshold(qint64 msecs);
+
+    static qint64 slowExecutionThreshold()
+    {
+        return sSlowExecutionThreshold.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * Replaces the handler that is invoked with the report of each slow
+     * execution. Passing an empty handler restores the default one.
+     *
+     * The handler is called from the thread that finished the execution.
+     */
+    static void setSlowExecutionHandler(const SlowExecutionHandler &handler);
+
+    static void setLiveExecutionTracking(bool enabled);
+
+    static bool isLiveExecutionTrackingEnabled()
+    {
+        return sLiveExecutionTracking.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * Returns the tracked top-level executions that have not finished yet,
+     * oldest first.
+     */
+    static QVector<ExecutionInfo> liveExecutions();
+
+    using WatchdogHandler = std::function<void(const QString &report)>;
+
+    /**
+     * Starts the watchdog in the current thread, which must run an event
+     * loop. This also enables live execution tracking.
+     *
+     * Every @p intervalMsecs the watchdog reports each execution that is
+     * pending for longer than @p stuckMsecs (once per execution), and if
+     * the event loop was blocked for more than @p lagMsecs since the last
+     * check, the lag as well. Starting the watchdog again replaces the
+     * previous settings.
+     */
+    static void startWatchdog(qint64 stuckMsecs, qint64 lagMsecs = 100, qint64 intervalMsecs = 1000);
+
+    /**
+     * Stops the watchdog. Must be called from the thread that started it.
+     */
+    static void stopWatchdog();
+
+    /**
+     * Replaces the handler that is invoked with the watchdog reports.
+     * Passing an empty handler restores the default one, which logs the
+     * report as a warning.
+     */
+    static void setWatchdogHandler(const WatchdogHandler &handler);
+
+private:
+    static std::atomic<qint64> sSlowExecutionThreshold;
+    static std::atomic<bool> sLiveExecutionTracking;
+};
+
+//@cond PRIVATE
+namespace Private {
+
+class ExecutionContext;
+
+/**
+ * Timing of all steps run on behalf of a single top-level execution.
+ */
+class KASYNC_EXPORT ExecutionProfile
+{
+public:
+    struct Step
+    {
+        const char *name;
+        int parent; // step that was running when the job of this step was executed
+        int prev;   // previous step in the same chain
+        qint64 created;
+        qint64 runStart;
+        qint64 finished;
+        bool error;
+    };
+
+    static bool isEnabled()
+    {
+        return Introspection::slowExecutionThreshold() > 0 || Introspection::isLiveExecutionTrackingEnabled();
+    }
+
+    /**
+     * Attaches the context to the profile of the currently running step,
+     * or to a new profile if no profiled step is running.
+     */
+    static void attach(ExecutionContext &context);
+
+    int addStep(const char *name, int parent, int prev);
+    void stepStarted(int step);
+    void stepFinished(int step, bool error);
+
+    /**
+     * Marks the step whose completion completes the whole execution.
+     */
+    void setRoot(int step, const QPointer<const QObject> &guard);
+
+    ExecutionInfo info(qint64 now) const;
+
+private:
+    void finish();
+    QString report(qint64 duration) const;
+
+    mutable QMutex mMutex;
+    std::vector<Step> mSteps;
+    qint64 mStart = 0;
+    quint64 mId = 0; // only set while registered as live execution
+    const char *mCurrentStep = nullptr;
+    QPointer<const QObject> mGuard;
+    int mRoot = -1;
+    bool mFinished = false;
+};
+
+using ExecutionProfilePtr = QSharedPointer<ExecutionProfile>;
+
+/**
+ * Marks a profiled step as running for the lifetime of the scope, so that
+ * jobs executed from within the step are attached to its profile.
+ */
+class KASYNC_EXPORT ProfileScope
+{
+public:
+    ProfileScope(const ExecutionProfilePtr &profile, int step)
+        : mProfile(profile ? &profile : nullptr)
+    {
+        if (Q_UNLIKELY(mProfile)) {
+            enter(step);
+        }
+    }
+
+    ~ProfileScope()
+    {
+        if (Q_UNLIKELY(mProfile)) {
+            leave();
+        }
+    }
+
+    ProfileScope(const ProfileScope &) = delete;
+    ProfileScope &operator=(const ProfileScope &) = delete;
+
+private:
+    friend class ExecutionProfile;
+
+    void enter(int step);
+    void leave();
+
+    const ExecutionProfilePtr *mProfile;
+    int mStep = -1;
+    ProfileScope *mOuter = nullptr;
+};
+
+} // namespace Private
+//@endcond
+
+} // namespace KAsync
+
+#endif // KASYNC_INTROSPECTION_H
@@ -11,7 +11,9 @@
 
 #include "async.h"
 #include "traits_p.h"
+#include "timersource.h"
 
+#include <QThread>
 #include <QTimer>
 
 //@cond PRIVATE
@@ -23,7 +25,7 @@ template<typename Out, typename ... In>
 template<typename ... InOther>
 Job<Out, In ...>::operator std::conditional_t<std::is_void<OutType>::value, IncompleteType, Job<void>> ()
 {
-    return thenImpl<void, InOther ...>({JobContinuation<void, InOther ...>([](InOther ...){ return KAsync::null<void>(); })}, {});
+    return thenImpl<void, InOther ...>({SyncContinuation<void, InOther ...>([](InOther ...){})}, {});
 }
 
 template<typename Out, typename ... In>
@@ -32,7 +34,7 @@ Job<OutOther, In ...> Job<Out, In ...>::thenImpl(Private::ContinuationHolder<Out
                                                  Private::ExecutionFlag execFlag) const
 {
     thenInvariants<InOther ...>();
-    return Job<OutOther, In ...>(QSharedPointer<Private::Executor<OutOther, InOther ...>>::create(
+    return Job<OutOther, In ...>(Private::IntrusivePtr<Private::Executor<OutOther, InOther ...>>::create(
                 std::forward<Private::ContinuationHolder<OutOther, InOther ...>>(workHelper), mExecutor, execFlag));
 }
 
@@ -49,7 +51,7 @@ Job<OutOther, In ...> Job<Out, In ...>::then(const Job<OutOther, InOther ...> &j
 template<typename Out, typename ... In>
 Job<Out, In ...> Job<Out, In ...>::onError(SyncErrorContinuation<void> &&errorFunc) const
 {
-    return Job<Out, In...>(QSharedPointer<Private::Executor<Out, Out>>::create(
+    return Job<Out, In...>(Private::IntrusivePtr<Private::Executor<Out, Out>>::create(
                 // Extra indirection to allow propagating the result of a previous future when no
                 // error occurs
                 Private::ContinuationHolder<Out, Out>([errorFunc = std::move(errorFunc)](const Error &error, const Out &val) {
@@ -61,7 +63,7 @@ Job<Out, In ...> Job<Out, In ...>::onError(SyncErrorContinuation<void> &&errorFu
 template<> // Specialize for void jobs
 inline Job<void> Job<void>::onError(SyncErrorContinuation<void> &&errorFunc) const
 {
-    return Job<void>(QSharedPointer<Private::Executor<void>>::create(
+    return Job<void>(Private::IntrusivePtr<Private::Executor<void>>::create(
                 Private::ContinuationHolder<void>(std::forward<SyncErrorContinuation<void>>(errorFunc)),
                 mExecutor, Private::ExecutionFlag::ErrorCase));
 }
@@ -70,32 +72,176 @@ template<typename Out, typename ... In>
 template<typename FirstIn>
 KAsync::Future<Out> Job<Out, In ...>::exec(FirstIn in)
 {
-    // Inject a fake sync executor that will return the initial value
-    Private::ExecutorBasePtr first = mExecutor;
-    while (first->mPrev) {
-        first = first->mPrev;
-    }
-
-    first->mPrev = QSharedPointer<Private::Executor<FirstIn>>::create(
-            Private::ContinuationHolder<FirstIn>([val = std::move(in)](Future<FirstIn> &future) {
-                 future.setResult(val);
-            }));
+    return exec(std::move(in), ExecutionValues());
+}
 
-    auto result = exec();
-    // Remove the injected executor
-    first->mPrev.reset();
-    return result;
+template<typename Out, typename ... In>
+template<typename FirstIn>
+KAsync::Future<Out> Job<Out, In ...>::exec(FirstIn in, const ExecutionValues &values)
+{
+    static_assert(sizeof...(In) == 1, "The first task does not take an argument");
+    // The input is passed through the context rather than through the
+    // executors, which are shared with other executions of the job.
+    std::decay_t<std::tuple_element_t<0, std::tuple<In ..., void>>> input(std::move(in));
+    return execImpl(&input, values);
 }
 
 template<typename Out, typename ... In>
 KAsync::Future<Out> Job<Out, In ...>::exec()
 {
-    Private::ExecutionPtr execution = mExecutor->exec(mExecutor, Private::ExecutionContext::Ptr::create());
+    return execImpl(nullptr, ExecutionValues());
+}
+
+template<typename Out, typename ... In>
+KAsync::Future<Out> Job<Out, In ...>::exec(const ExecutionValues &values)
+{
+    return execImpl(nullptr, values);
+}
+
+template<typename Out, typename ... In>
+KAsync::Future<Out> Job<Out, In ...>::execImpl(void *firstIn, const ExecutionValues &values,
+                                               Private::ExecutionPool *pool)
+{
+    auto context = Private::ExecutionContext::Ptr::create();
+    context->values = values.d;
+    context->pool = Private::IntrusivePtr<Private::ExecutionPool>(pool);
+    return execImpl(firstIn, context);
+}
+
+template<typename Out, typename ... In>
+KAsync::Future<Out> Job<Out, In ...>::execImpl(void *firstIn, const Private::ExecutionContext::Ptr &context) const
+{
+    context->firstIn = firstIn;
+    if (Q_UNLIKELY(Private::ExecutionProfile::isEnabled())) {
+        Private::ExecutionProfile::attach(*context);
+    }
+    Private::ExecutionPtr execution = mExecutor->exec(mExecutor, context);
+    if (Q_UNLIKELY(context->profile && context->profileParent < 0)) {
+        context->profile->setRoot(execution->profileStep, context->firstGuard);
+    }
+    context->firstIn = nullptr;
     KAsync::Future<Out> result = *execution->result<Out>();
 
     return result;
 }
 
+template<typename Out, typename ... In>
+template<typename FirstIn>
+Result<Out> Job<Out, In ...>::execSync(FirstIn in)
+{
+    static_assert(sizeof...(In) == 1, "The first task does not take an argument");
+    const std::decay_t<std::tuple_element_t<0, std::tuple<In ..., void>>> input(std::move(in));
+    return execSyncImpl(&input);
+}
+
+template<typename Out, typename ... In>
+Result<Out> Job<Out, In ...>::execSync()
+{
+    return execSyncImpl(nullptr);
+}
+
+template<typename Out, typename ... In>
+Result<Out> Job<Out, In ...>::execSyncImpl(const void *firstIn)
+{
+    // The steps do not see the values of an execution running this one
+    const Private::ExecutionContext::Scope scope(nullptr);
+    Private::SyncExecution sync;
+    sync.firstIn = firstIn;
+    if (!mExecutor->prepareSync(sync)) {
+        qCWarning(Debug) << "execSync() called on a job with asynchronous steps";
+        return Error(1, "The job contains asynchronous steps");
+    }
+    Result<Out> result;
+    mExecutor->execSync(&result, false, sync);
+    return result;
+}
+
+template<typename Out, typename ... In>
+PreparedJob<Out, In ...> Job<Out, In ...>::prepare() const
+{
+    return PreparedJob<Out, In ...>(*this);
+}
+
+template<typename Out, typename ... In>
+PreparedJob<Out, In ...>::PreparedJob(const Job<Out, In ...> &job)
+    : mJob(job)
+    , mSynchronous(job.mExecutor->prepareSync(mSync))
+    , mPool(Private::IntrusivePtr<Private::ExecutionPool>::create())
+{}
+
+template<typename Out, typename ... In>
+template<typename FirstIn>
+KAsync::Future<Out> PreparedJob<Out, In ...>::exec(FirstIn in)
+{
+    return exec(std::move(in), ExecutionValues());
+}
+
+template<typename Out, typename ... In>
+template<typename FirstIn>
+KAsync::Future<Out> PreparedJob<Out, In ...>::exec(FirstIn in, const ExecutionValues &values)
+{
+    static_assert(sizeof...(In) == 1, "The first task does not take an argument");
+    std::decay_t<std::tuple_element_t<0, std::tuple<In ..., void>>> input(std::move(in));
+    return execImpl(&input, values);
+}
+
+template<typename Out, typename ... In>
+KAsync::Future<Out> PreparedJob<Out, In ...>::exec()
+{
+    return execImpl(nullptr, ExecutionValues());
+}
+
+template<typename Out, typename ... In>
+KAsync::Future<Out> PreparedJob<Out, In ...>::exec(const ExecutionValues &values)
+{
+    return execImpl(nullptr, values);
+}
+
+template<typename Out, typename ... In>
+KAsync::Future<Out> PreparedJob<Out, In ...>::execImpl(void *firstIn, const ExecutionValues &values)
+{
+    // Tracing and profiling need the executions of the steps
+    if (!mSynchronous || Q_UNLIKELY(Tracer::isEnabled() || Private::ExecutionProfile::isEnabled())) {
+        return mJob.execImpl(firstIn, values, mPool.data());
+    }
+    // The steps only need a context to read the values from, if there are any
+    Private::ExecutionContext::Ptr context;
+    if (values.d) {
+        context = Private::ExecutionContext::Ptr::create();
+        context->values = values.d;
+    }
+    const Private::ExecutionContext::Scope scope(context ? &context : nullptr);
+    Private::SyncExecution sync = mSync;
+    sync.firstIn = firstIn;
+    Result<Out> result;
+    mJob.mExecutor->execSync(&result, false, sync);
+    KAsync::Future<Out> future;
+    applyResult(result, future);
+    return future;
+}
+
+template<typename Out, typename ... In>
+template<typename T>
+void PreparedJob<Out, In ...>::applyResult(Result<T> &result, KAsync::Future<T> &future)
+{
+    if (result.hasError()) {
+        future.setError(result.error());
+    } else {
+        *future = std::move(result.value());
+        future.setFinished();
+    }
+}
+
+template<typename Out, typename ... In>
+void PreparedJob<Out, In ...>::applyResult(Result<void> &result, KAsync::Future<void> &future)
+{
+    if (result.hasError()) {
+        future.setError(result.error());
+    } else {
+        future.setFinished();
+    }
+}
+
 template<typename Out, typename ... In>
 Job<Out, In ...>::Job(Private::ExecutorBasePtr executor)
     : JobBase(executor)
@@ -133,48 +279,115 @@ auto Job<Out, In ...>::thenInvariants() const -> std::enable_if_t<(sizeof...(InO
 {
 }
 
+namespace Private {
+
+template<typename Out>
+KAsync::Future<Out> startNested(const Job<Out> &job)
+{
+    return job.execImpl(nullptr, ExecutionContext::createNested());
+}
+
+template<typename Out, typename In, typename FirstIn>
+KAsync::Future<Out> startNested(const Job<Out, In> &job, FirstIn in)
+{
+    std::decay_t<In> input(std::move(in));
+    return job.execImpl(&input, ExecutionContext::createNested());
+}
+
+} // namespace Private
+
 template<template<typename> class Container>
 KAsync::Job<void> waitForCompletion(Container<KAsync::Future<void>> &futures)
 {
-    struct Context {
-        void removeWatcher(KAsync::FutureWatcher<void> *w)
-        {
-            pending.erase(std::remove_if(pending.begin(), pending.end(), [w](const auto &watcher) {
-                return w == watcher.get();
-            }));
-        }
+    return start<void>([futures](KAsync::Future<void> &future) {
+            Private::CompletionLatch::waitForAll(futures, [future]() mutable {
+                future.setFinished();
+            });
+        });
+}
 
-        std::vector<std::unique_ptr<KAsync::FutureWatcher<void>>> pending;
-    };
+template<typename T>
+Job<QVector<T>> whenAll(const QVector<KAsync::Future<T>> &futures)
+{
+    static_assert(!std::is_void<T>::value, "Use waitForCompletion() for futures without a value");
+    return start<QVector<T>>([futures](KAsync::Future<QVector<T>> &future) {
+            Private::CompletionLatch::waitForAll(futures, [futures, future]() mutable {
+                for (const auto &f : qAsConst(futures)) {
+                    if (f.hasError()) {
+                        future.setError(f.errors().first());
+                        return;
+                    }
+                }
+                // The values are copied, the caller may still use the futures
+                QVector<T> values(futures.size());
+                for (int i = 0; i < futures.size(); ++i) {
+                    values[i] = *futures.at(i);
+                }
+                *future = std::move(values);
+                future.setFinished();
+            });
+        });
+}
 
-    return start<Context *>([]() {
-            return new Context();
-        })
-        .template then<Context*, Context*>([futures](Context *context, KAsync::Future<Context *> &future) {
-            for (KAsync::Future<void> subFuture : futures) {
-                if (subFuture.isFinished()) {
-                    continue;
+template<typename T>
+Job<QVector<Result<T>>> whenAllSettled(const QVector<KAsync::Future<T>> &futures)
+{
+    static_assert(!std::is_void<T>::value, "Use waitForCompletion() for futures without a value");
+    return start<QVector<Result<T>>>([futures](KAsync::Future<QVector<Result<T>>> &future) {
+            Private::CompletionLatch::waitForAll(futures, [futures, future]() mutable {
+                QVector<Result<T>> results(futures.size());
+                for (int i = 0; i < futures.size(); ++i) {
+                    const KAsync::Future<T> &f = futures.at(i);
+                    if (f.hasError()) {
+                        results[i] = f.errors().first();
+                    } else {
+                        results[i] = *f;
+                    }
                 }
-                // FIXME bind lifetime all watcher to future (respectively the main job)
-                auto watcher = std::make_unique<KAsync::FutureWatcher<void>>();
-                QObject::connect(watcher.get(), &KAsync::FutureWatcher<void>::futureReady,
-                                 [&future, watcher = watcher.get(), context]() {
-                                    context->removeWatcher(watcher);
-                                    if (context->pending.empty()) {
-                                        future.setResult(context);
-                                    }
-                                });
-                watcher->setFuture(subFuture);
-                context->pending.push_back(std::move(watcher));
-            }
-            if (context->pending.empty()) {
-                future.setResult(context);
-            }
-        })
-        .template then<void, Context*>([](Context *context) {
-            delete context;
+                *future = std::move(results);
+                future.setFinished();
+            });
+        });
+}
+
+namespace Private {
+
+// Finishes the future of parallel() with the values of its branches
+template<typename ... Out, std::size_t ... I>
+void finishParallel(std::tuple<KAsync::Future<Out> ...> &branches, KAsync::Future<std::tuple<Out ...>> &future,
+                    std::index_sequence<I ...>)
+{
+    const KAsync::FutureBase *results[] = {&std::get<I>(branches) ...};
+    for (const auto *result : results) {
+        if (result->hasError()) {
+            future.setError(result->errors().first());
+            return;
+        }
+    }
+    *future = std::tuple<Out ...>(std::move(*std::get<I>(branches)) ...);
+    future.setFinished();
+}
+
+} // namespace Private
+
+template<typename ... Out>
+Job<std::tuple<Out ...>> parallel(Job<Out> ... jobs)
+{
+    static_assert(sizeof...(Out) > 0, "parallel() needs at least one job");
+    static_assert(!std::disjunction<std::is_void<Out> ...>::value, "The jobs passed to parallel() must have a value");
+    return start<std::tuple<Out ...>>([jobs ...](KAsync::Future<std::tuple<Out ...>> &future) mutable {
+            // All branches are started before waiting for any of them. They
+            // are part of the running execution, so they see its values and
+            // are cancelled together with it.
+            std::tuple<KAsync::Future<Out> ...> branches{Private::startNested(jobs) ...};
+            auto latch = new Private::CompletionLatch(sizeof...(Out), [branches, future]() mutable {
+                Private::finishParallel(branches, future, std::index_sequence_for<Out ...>());
+            });
+            std::apply([latch](auto & ... branch) {
+                (latch->wait(branch), ...);
+            }, branches);
+            latch->start();
         });
-        // .finally<void>([context]() { delete context; });
 }
 
 template<typename List, typename ValueType>
@@ -184,14 +397,13 @@ Job<void, List> forEach(KAsync::Job<void, ValueType> job)
             auto error = QSharedPointer<KAsync::Error>::create();
             QVector<KAsync::Future<void>> list;
             for (const auto &v : values) {
-                auto future = job
+                auto future = Private::startNested(job
                     .template then<void>([error] (const KAsync::Error &e) {
                         if (e && !*error) {
                             //TODO ideally we would aggregate the errors instead of just using the first one
                             *error = e;
                         }
-                    })
-                    .exec(v);
+                    }), v);
                 list.push_back(future);
             }
             return waitForCompletion(list)
@@ -203,7 +415,7 @@ Job<void, List> forEach(KAsync::Job<void, ValueType> job)
                     }
                 });
         };
-    return Job<void, List>(QSharedPointer<Private::Executor<void, List>>::create(
+    return Job<void, List>(Private::IntrusivePtr<Private::Executor<void, List>>::create(
                 Private::ContinuationHolder<void, List>(JobContinuation<void, List>(std::move(cont))), nullptr, Private::ExecutionFlag::GoodCase));
 }
 
@@ -216,14 +428,13 @@ Job<void, List> serialForEach(KAsync::Job<void, ValueType> job)
             auto serialJob = KAsync::null<void>();
             for (const auto &value : values) {
                 serialJob = serialJob.then<void>([value, job, error](KAsync::Future<void> &future) {
-                    job.template then<void>([&future, error] (const KAsync::Error &e) {
+                    Private::startNested(job.template then<void>([&future, error] (const KAsync::Error &e) {
                         if (e && !*error) {
                             //TODO ideally we would aggregate the errors instead of just using the first one
                             *error = e;
                         }
                         future.setFinished();
-                    })
-                    .exec(value);
+                    }), value);
                 });
             }
             return serialJob
@@ -235,7 +446,7 @@ Job<void, List> serialForEach(KAsync::Job<void, ValueType> job)
                     }
                 });
         };
-    return Job<void, List>(QSharedPointer<Private::Executor<void, List>>::create(
+    return Job<void, List>(Private::IntrusivePtr<Private::Executor<void, List>>::create(
             Private::ContinuationHolder<void, List>(JobContinuation<void, List>(std::move(cont))), nullptr, Private::ExecutionFlag::GoodCase));
 }
 
@@ -255,8 +466,8 @@ template<typename Out>
 Job<Out> null()
 {
     return KAsync::start<Out>(
-        [](KAsync::Future<Out> &future) {
-            future.setFinished();
+        [] {
+            return Out();
         });
 }
 
@@ -264,8 +475,8 @@ template<typename Out>
 Job<Out> value(Out v)
 {
     return KAsync::start<Out>(
-        [val = std::move(v)](KAsync::Future<Out> &future) {
-            future.setResult(val);
+        [val = std::move(v)] {
+            return val;
         });
 }
 
@@ -293,21 +504,21 @@ Job<Out> error(const Error &error)
 inline Job<void> doWhile(const Job<ControlFlowFlag> &body)
 {
     return KAsync::start<void>([body] (KAsync::Future<void> &future) {
-        auto job = body.then<void, ControlFlowFlag>([&future, body](const KAsync::Error &error, ControlFlowFlag flag) {
+        Private::startNested(body.then<void, ControlFlowFlag>([&future, body](const KAsync::Error &error, ControlFlowFlag flag) {
             if (error) {
                 future.setError(error);
                 future.setFinished();
             } else if (flag == ControlFlowFlag::Continue) {
-                doWhile(body).then<void>([&future](const KAsync::Error &error) {
+                Private::startNested(doWhile(body).then<void>([&future](const KAsync::Error &error) {
                     if (error) {
                         future.setError(error);
                     }
                     future.setFinished();
-                }).exec();
+                }));
             } else {
                 future.setFinished();
             }
-        }).exec();
+        }));
     });
 }
 
@@ -318,10 +529,55 @@ inline Job<void> doWhile(const JobContinuation<ControlFlowFlag> &body)
     }));
 }
 
+template<typename T>
+const T *executionValue()
+{
+    const auto &context = Private::ExecutionContext::current();
+    if (!context || !context->values) {
+        return nullptr;
+    }
+    return context->values.constData()->template get<T>();
+}
+
 inline Job<void> wait(int delay)
 {
     return KAsync::start<void>([delay](KAsync::Future<void> &future) {
-        QTimer::singleShot(delay, [&future]() {
+        TimerSource *source = TimerSource::instance();
+        const auto &context = Private::ExecutionContext::current();
+        if (!context || !context->isCancellable()) {
+            source->singleShot(delay, [future]() mutable {
+                future.setFinished();
+            });
+            return;
+        }
+        // Stop waiting when a guard of the execution is destroyed, which may
+        // happen on another thread. Whichever of the cancel hook and the
+        // timer comes first finishes the future, the timer is stopped by
+        // destroying its context.
+        struct State {
+            std::atomic<bool> done{false};
+            int cancelHook = 0;
+            QObject *timerContext = nullptr;
+        };
+        auto state = std::make_shared<State>();
+        state->timerContext = new QObject;
+        state->cancelHook = context->addCancelHook([future, state]() mutable {
+            if (state->done.exchange(true)) {
+                return;
+            }
+            if (state->timerContext->thread() == QThread::currentThread()) {
+                delete state->timerContext;
+            } else {
+                state->timerContext->deleteLater();
+            }
+            future.setFinished();
+        });
+        source->singleShot(delay, state->timerContext, [future, context, state]() mutable {
+            if (state->done.exchange(true)) {
+                return;
+            }
+            context->removeCancelHook(state->cancelHook);
+            state->timerContext->deleteLater();
             future.setFinished();
         });
     });
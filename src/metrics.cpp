@@ -0,0 +1,274 @@
+/*
+    SPDX-FileCopyrightText: 2026 KAsync contributors
+
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#include "metrics.h"
+
+#include "debug.h"
+
+#include <QCoreApplication>
+#include <QHash>
+#include <QMutex>
+#include <QStringBuilder>
+
+#include <chrono>
+#include <deque>
+
+#if defined(Q_OS_WIN)
+#include <windows.h>
+#elif defined(Q_OS_UNIX)
+#include <time.h>
+#endif
+
+using namespace KAsync;
+
+namespace KAsync {
+namespace Private {
+
+class StepLabel
+{
+public:
+    enum { Buckets = 64 };
+
+    explicit StepLabel(const QByteArray &name)
+        : name(name)
+    {
+        reset();
+    }
+
+    void reset()
+    {
+        invocations.store(0, std::memory_order_relaxed);
+        errors.store(0, std::memory_order_relaxed);
+        totalWallTime.store(0, std::memory_order_relaxed);
+        maxWallTime.store(0, std::memory_order_relaxed);
+        totalCpuTime.store(0, std::memory_order_relaxed);
+        for (auto &bucket : histogram) {
+            bucket.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    const QByteArray name;
+    std::atomic<quint64> invocations;
+    std::atomic<quint64> errors;
+    std::atomic<qint64> totalWallTime;
+    std::atomic<qint64> maxWallTime;
+    std::atomic<qint64> totalCpuTime;
+    std::atomic<quint64> histogram[Buckets];
+};
+
+} // namespace Private
+} // namespace KAsync
+
+namespace {
+
+struct LabelRegistry
+{
+    QMutex mutex;
+    QHash<QByteArray, Private::StepLabel *> byName;
+    // Labels are never released so that executors can refer to them by pointer.
+    std::deque<Private::StepLabel> labels;
+};
+
+LabelRegistry &labelRegistry()
+{
+    static LabelRegistry registry;
+    return registry;
+}
+
+const char *trackedObjectName(int type)
+{
+    switch (static_cast<TrackedObject>(type)) {
+    case TrackedObject::Executor:
+        return "Executor";
+    case TrackedObject::Execution:
+        return "Execution";
+    case TrackedObject::FuturePrivate:
+        return "FuturePrivate";
+    case TrackedObject::FutureWatcher:
+        return "FutureWatcher";
+    case TrackedObject::ExecutionContext:
+        return "ExecutionContext";
+    }
+    return "";
+}
+
+void shutdownReport()
+{
+    if (Metrics::isEnabled()) {
+        qCWarning(Debug).noquote() << Metrics::objectCountReport();
+    }
+}
+
+void registerShutdownReport()
+{
+    qAddPostRoutine(shutdownReport);
+}
+
+int histogramBucket(qint64 value)
+{
+    int bucket = 0;
+    while (value > 1 && bucket < Private::StepLabel::Buckets - 1) {
+        value >>= 1;
+        ++bucket;
+    }
+    return bucket;
+}
+
+}
+
+Q_COREAPP_STARTUP_FUNCTION(registerShutdownReport)
+
+std::atomic<bool> Metrics::sEnabled{qEnvironmentVariableIsSet("KASYNC_METRICS")};
+Private::InstanceCount Private::InstanceCounts::counts[Private::InstanceCounts::size];
+
+qint64 StepMetrics::latencyPercentile(double percentile) const
+{
+    if (invocations == 0) {
+        return 0;
+    }
+    const double threshold = invocations * percentile / 100.0;
+    quint64 count = 0;
+    for (int i = 0; i < latencyHistogram.size(); ++i) {
+        count += latencyHistogram[i];
+        if (count >= threshold && count > 0) {
+            return i >= 62 ? maxWallTime : (Q_INT64_C(1) << (i + 1));
+        }
+    }
+    return maxWallTime;
+}
+
+void Metrics::setEnabled(bool enabled)
+{
+    sEnabled.store(enabled, std::memory_order_relaxed);
+}
+
+QVector<StepMetrics> Metrics::snapshot()
+{
+    auto &registry = labelRegistry();
+    QMutexLocker locker(&registry.mutex);
+
+    QVector<StepMetrics> result;
+    result.reserve(static_cast<int>(registry.labels.size()));
+    for (const auto &label : registry.labels) {
+        StepMetrics metrics;
+        metrics.name = label.name;
+        metrics.invocations = label.invocations.load(std::memory_order_relaxed);
+        metrics.errors = label.errors.load(std::memory_order_relaxed);
+        metrics.totalWallTime = label.totalWallTime.load(std::memory_order_relaxed);
+        metrics.maxWallTime = label.maxWallTime.load(std::memory_order_relaxed);
+        metrics.totalCpuTime = label.totalCpuTime.load(std::memory_order_relaxed);
+        metrics.latencyHistogram.resize(Private::StepLabel::Buckets);
+        for (int i = 0; i < Private::StepLabel::Buckets; ++i) {
+            metrics.latencyHistogram[i] = label.histogram[i].load(std::memory_order_relaxed);
+        }
+        result.push_back(metrics);
+    }
+    return result;
+}
+
+void Metrics::reset()
+{
+    auto &registry = labelRegistry();
+    QMutexLocker locker(&registry.mutex);
+    for (auto &label : registry.labels) {
+        label.reset();
+    }
+}
+
+ObjectCount Metrics::objectCount(TrackedObject type)
+{
+    const auto &count = Private::InstanceCounts::counts[static_cast<int>(type)];
+    ObjectCount result;
+    result.live = count.live.load(std::memory_order_relaxed);
+    result.peak = count.peak.load(std::memory_order_relaxed);
+    return result;
+}
+
+void Metrics::resetPeakObjectCounts()
+{
+    for (auto &count : Private::InstanceCounts::counts) {
+        count.peak.store(count.live.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    }
+}
+
+QString Metrics::objectCountReport()
+{
+    QString report = QStringLiteral("KAsync object counts (live/peak):");
+    for (int i = 0; i < Private::InstanceCounts::size; ++i) {
+        const auto count = objectCount(static_cast<TrackedObject>(i));
+        report += QLatin1Char(' ') % QLatin1String(trackedObjectName(i)) % QLatin1Char(' ')
+                  % QString::number(count.live) % QLatin1Char('/') % QString::number(count.peak);
+    }
+    return report;
+}
+
+void Private::InstanceCounts::updatePeak(InstanceCount &count, qint64 live)
+{
+    qint64 peak = count.peak.load(std::memory_order_relaxed);
+    while (live > peak && !count.peak.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {
+    }
+}
+
+Private::StepLabel *Private::stepLabel(const char *name)
+{
+    const QByteArray key(name);
+    auto &registry = labelRegistry();
+    QMutexLocker locker(&registry.mutex);
+    auto label = registry.byName.value(key);
+    if (!label) {
+        registry.labels.emplace_back(key);
+        label = &registry.labels.back();
+        registry.byName.insert(key, label);
+    }
+    return label;
+}
+
+const char *Private::stepLabelName(const StepLabel *label)
+{
+    return label->name.constData();
+}
+
+void Private::recordStep(StepLabel *label, qint64 wallTime, qint64 cpuTime, bool error)
+{
+    label->invocations.fetch_add(1, std::memory_order_relaxed);
+    if (error) {
+        label->errors.fetch_add(1, std::memory_order_relaxed);
+    }
+    label->totalWallTime.fetch_add(wallTime, std::memory_order_relaxed);
+    label->totalCpuTime.fetch_add(cpuTime, std::memory_order_relaxed);
+    qint64 max = label->maxWallTime.load(std::memory_order_relaxed);
+    while (wallTime > max && !label->maxWallTime.compare_exchange_weak(max, wallTime, std::memory_order_relaxed)) {
+    }
+    label->histogram[histogramBucket(wallTime)].fetch_add(1, std::memory_order_relaxed);
+}
+
+qint64 Private::monotonicTime()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+qint64 Private::threadCpuTime()
+{
+#if defined(Q_OS_WIN)
+    FILETIME creation, exit, kernel, user;
+    if (!GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user)) {
+        return 0;
+    }
+    const auto toNs = [](const FILETIME &ft) {
+        return ((static_cast<qint64>(ft.dwHighDateTime) << 32) | ft.dwLowDateTime) * 100;
+    };
+    return toNs(kernel) + toNs(user);
+#elif defined(Q_OS_UNIX) && defined(CLOCK_THREAD_CPUTIME_ID)
+    timespec ts;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0) {
+        return 0;
+    }
+    return static_cast<qint64>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+#else
+    return 0;
+#endif
+}
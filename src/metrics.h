@@ -0,0 +1,199 @@
+/*
+    SPDX-FileCopyrightText: 2026 KAsync contributors
+
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#ifndef KASYNC_METRICS_H
+#define KASYNC_METRICS_H
+
+#include "kasync_export.h"
+
+#include <QByteArray>
+#include <QString>
+#include <QVector>
+
+#include <atomic>
+
+namespace KAsync {
+
+/**
+ * @brief Runtime statistics of all steps sharing a name.
+ *
+ * Times are in nanoseconds. The wall time of a step is measured from the
+ * invocation of its continuation until its Future is finished, the CPU time
+ * only covers the invocation of the continuation itself on the calling thread.
+ *
+ * @see Job::named(), Metrics::snapshot()
+ */
+struct KASYNC_EXPORT StepMetrics
+{
+    QByteArray name;
+    quint64 invocations = 0;
+    quint64 errors = 0;
+    qint64 totalWallTime = 0;
+    qint64 maxWallTime = 0;
+    qint64 totalCpuTime = 0;
+
+    /**
+     * Bucket @c i counts the invocations with a wall time in the range
+     * [2^i, 2^(i+1)) nanoseconds.
+     */
+    QVector<quint64> latencyHistogram;
+
+    /**
+     * Returns the upper bound of the histogram bucket containing the given
+     * @p percentile (0 - 100) of the wall time, or 0 if there is no data.
+     */
+    qint64 latencyPercentile(double percentile) const;
+};
+
+/**
+ * @brief Types of internal objects whose instances are counted.
+ *
+ * @see Metrics::objectCount()
+ */
+enum class TrackedObject {
+    Executor,           ///< One per step of each Job
+    Execution,          ///< One per step of each running execution
+    FuturePrivate,      ///< Shared state of a Future
+    FutureWatcher,      ///< Any FutureWatcher, including internal ones
+    ExecutionContext    ///< One per Job::exec()
+};
+
+/**
+ * @brief Number of live instances of a TrackedObject.
+ */
+struct KASYNC_EXPORT ObjectCount
+{
+    qint64 live = 0;
+    /**
+     * Highest number of live instances since the last reset, only tracked
+     * while metrics are enabled.
+     */
+    qint64 peak = 0;
+};
+
+/**
+ * @brief Collects per-step metrics of executed jobs.
+ *
+ * Only steps that were given a name using Job::named() are measured, steps
+ * with the same name are aggregated together. Collection is disabled by
+ * default, in which case it costs a single check per executed step.
+ *
+ * Collection can also be enabled from the start by setting the
+ * KASYNC_METRICS environment variable.
+ *
+ * Independent of that, the live instances of the internal objects making up
+ * jobs and their executions are always counted, which makes leaking
+ * executions (e.g. because a Future is never finished) measurable. Their
+ * peak counts are only tracked while collection is enabled. If metrics are
+ * enabled when the QCoreApplication is destroyed, the final counts are
+ * logged.
+ */
+class KASYNC_EXPORT Metrics
+{
+public:
+    static void setEnabled(bool enabled);
+
+    static bool isEnabled()
+    {
+        return sEnabled.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * Returns the metrics collected so far for all named steps.
+     */
+    static QVector<StepMetrics> snapshot();
+
+    /**
+     * Resets the collected metrics of all named steps to zero.
+     */
+    static void reset();
+
+    static ObjectCount objectCount(TrackedObject type);
+
+    /**
+     * Resets the peak counts to the current number of live instances.
+     */
+    static void resetPeakObjectCounts();
+
+    /**
+     * Returns a human readable summary of all object counts.
+     */
+    static QString objectCountReport();
+
+private:
+    static std::atomic<bool> sEnabled;
+};
+
+//@cond PRIVATE
+namespace Private {
+
+class StepLabel;
+
+KASYNC_EXPORT StepLabel *stepLabel(const char *name);
+KASYNC_EXPORT const char *stepLabelName(const StepLabel *label);
+KASYNC_EXPORT void recordStep(StepLabel *label, qint64 wallTime, qint64 cpuTime, bool error);
+
+KASYNC_EXPORT qint64 monotonicTime();
+KASYNC_EXPORT qint64 threadCpuTime();
+
+/**
+ * Counts of a TrackedObject. Each is on a cache line of its own, as they are
+ * updated from all threads.
+ */
+struct alignas(64) InstanceCount
+{
+    std::atomic<qint64> live{0};
+    std::atomic<qint64> peak{0};
+};
+
+struct KASYNC_EXPORT InstanceCounts
+{
+    static constexpr int size = static_cast<int>(TrackedObject::ExecutionContext) + 1;
+    static InstanceCount counts[size];
+
+    static void updatePeak(InstanceCount &count, qint64 live);
+};
+
+inline void countInstance(TrackedObject type, int delta)
+{
+    auto &count = InstanceCounts::counts[static_cast<int>(type)];
+    const qint64 live = count.live.fetch_add(delta, std::memory_order_relaxed) + delta;
+    if (delta > 0 && Q_UNLIKELY(Metrics::isEnabled())) {
+        InstanceCounts::updatePeak(count, live);
+    }
+}
+
+/**
+ * Base class counting the instances of the derived class.
+ */
+template<TrackedObject Type>
+class InstanceCounter
+{
+protected:
+    InstanceCounter()
+    {
+        countInstance(Type, 1);
+    }
+
+    InstanceCounter(const InstanceCounter &)
+    {
+        countInstance(Type, 1);
+    }
+
+    InstanceCounter &operator=(const InstanceCounter &) = default;
+
+    ~InstanceCounter()
+    {
+        countInstance(Type, -1);
+    }
+};
+
+} // namespace Private
+//@endcond
+
+} // namespace KAsync
+
+#endif // KASYNC_METRICS_H
@@ -0,0 +1,179 @@
+/*
+    SPDX-FileCopyrightText: 2026 KAsync contributors
+
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#ifndef KASYNC_REFCOUNTED_P_H_
+#define KASYNC_REFCOUNTED_P_H_
+
+#include <QAtomicInt>
+
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+
+namespace KAsync {
+
+//@cond PRIVATE
+namespace Private
+{
+
+/**
+ * Base class of objects owned by IntrusivePtr.
+ *
+ * The reference count is embedded in the object, so there is no separate
+ * control block and copying a pointer touches a single atomic counter.
+ * There are no weak references, objects that need to be observed clear the
+ * observer's pointer themselves when they are destroyed.
+ */
+class RefCounted
+{
+public:
+    RefCounted(const RefCounted &) = delete;
+    RefCounted &operator=(const RefCounted &) = delete;
+
+    void ref() const
+    {
+        mRefCount.ref();
+    }
+
+    // Returns false once the last reference is gone
+    bool deref() const
+    {
+        return mRefCount.deref();
+    }
+
+protected:
+    RefCounted() = default;
+    ~RefCounted() = default;
+
+private:
+    mutable QAtomicInt mRefCount;
+};
+
+/**
+ * Shared pointer to a RefCounted object, with the subset of the QSharedPointer
+ * API used internally.
+ */
+template<typename T>
+class IntrusivePtr
+{
+public:
+    IntrusivePtr() = default;
+
+    IntrusivePtr(std::nullptr_t)
+    {}
+
+    explicit IntrusivePtr(T *ptr)
+        : mPtr(ptr)
+    {
+        if (mPtr) {
+            mPtr->ref();
+        }
+    }
+
+    IntrusivePtr(const IntrusivePtr &other)
+        : IntrusivePtr(other.mPtr)
+    {}
+
+    IntrusivePtr(IntrusivePtr &&other) noexcept
+        : mPtr(other.mPtr)
+    {
+        other.mPtr = nullptr;
+    }
+
+    template<typename U, typename = std::enable_if_t<std::is_convertible<U *, T *>::value>>
+    IntrusivePtr(const IntrusivePtr<U> &other)
+        : IntrusivePtr(other.data())
+    {}
+
+    template<typename U, typename = std::enable_if_t<std::is_convertible<U *, T *>::value>>
+    IntrusivePtr(IntrusivePtr<U> &&other) noexcept
+        : mPtr(other.take())
+    {}
+
+    ~IntrusivePtr()
+    {
+        if (mPtr && !mPtr->deref()) {
+            delete mPtr;
+        }
+    }
+
+    IntrusivePtr &operator=(IntrusivePtr other) noexcept
+    {
+        swap(other);
+        return *this;
+    }
+
+    template<typename ... Args>
+    static IntrusivePtr create(Args && ... args)
+    {
+        return IntrusivePtr(new T(std::forward<Args>(args) ...));
+    }
+
+    void swap(IntrusivePtr &other) noexcept
+    {
+        std::swap(mPtr, other.mPtr);
+    }
+
+    void reset()
+    {
+        IntrusivePtr().swap(*this);
+    }
+
+    // Gives up the reference without releasing it
+    T *take()
+    {
+        T *ptr = mPtr;
+        mPtr = nullptr;
+        return ptr;
+    }
+
+    T *data() const
+    {
+        return mPtr;
+    }
+
+    T *operator->() const
+    {
+        return mPtr;
+    }
+
+    T &operator*() const
+    {
+        return *mPtr;
+    }
+
+    explicit operator bool() const
+    {
+        return mPtr;
+    }
+
+    bool operator!() const
+    {
+        return !mPtr;
+    }
+
+private:
+    T *mPtr = nullptr;
+};
+
+template<typename T, typename U>
+bool operator==(const IntrusivePtr<T> &lhs, const IntrusivePtr<U> &rhs)
+{
+    return lhs.data() == rhs.data();
+}
+
+template<typename T, typename U>
+bool operator!=(const IntrusivePtr<T> &lhs, const IntrusivePtr<U> &rhs)
+{
+    return lhs.data() != rhs.data();
+}
+
+} // namespace Private
+//@endcond
+
+} // namespace KAsync
+
+#endif
@@ -0,0 +1,219 @@
+/*
+    SPDX-FileCopyrightText: 2026 KAsync contributors
+
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#include "timersource.h"
+#include "metrics.h"
+
+#include <QAbstractEventDispatcher>
+#include <QMutex>
+#include <QObject>
+#include <QTimer>
+
+#include <map>
+#include <unordered_map>
+
+using namespace KAsync;
+
+namespace {
+
+class SystemTimerSource : public TimerSource
+{
+public:
+    qint64 now() const override
+    {
+        return Private::monotonicTime() / 1000000;
+    }
+
+    void singleShot(int msecs, const QObject *context, const Callback &callback) override
+    {
+        if (context) {
+            QTimer::singleShot(msecs, context, callback);
+        } else {
+            QTimer::singleShot(msecs, callback);
+        }
+    }
+};
+
+SystemTimerSource systemTimerSource;
+
+}
+
+class VirtualTimerSource::Private
+{
+public:
+    // Fires the earliest timer if it is due at or before target, returns
+    // false if there is none.
+    bool fireNext(qint64 target);
+    // Drops the timer with the given id, whose context was destroyed
+    void stop(quint64 id);
+
+    struct Timer
+    {
+        quint64 id;
+        Callback callback;
+        QMetaObject::Connection contextDestroyed;
+    };
+    using Timers = std::multimap<qint64, Timer>;
+
+    mutable QMutex mutex;
+    qint64 now = 0;
+    quint64 lastId = 0;
+    // multimap keeps timers with equal deadlines in insertion order
+    Timers timers;
+    // Only timers with a context are looked up by id
+    std::unordered_map<quint64, Timers::iterator> timersById;
+
+    bool autoAdvance;
+    bool advanceQueued = false;
+    QObject context;
+    QMetaObject::Connection aboutToBlock;
+};
+
+bool VirtualTimerSource::Private::fireNext(qint64 target)
+{
+    QMutexLocker locker(&mutex);
+    if (timers.empty() || timers.begin()->first > target) {
+        return false;
+    }
+    auto it = timers.begin();
+    now = it->first;
+    const Callback callback = std::move(it->second.callback);
+    const QMetaObject::Connection contextDestroyed = it->second.contextDestroyed;
+    timersById.erase(it->second.id);
+    timers.erase(it);
+    locker.unlock();
+
+    QObject::disconnect(contextDestroyed);
+    callback();
+    return true;
+}
+
+void VirtualTimerSource::Private::stop(quint64 id)
+{
+    Callback callback;
+    QMutexLocker locker(&mutex);
+    const auto it = timersById.find(id);
+    if (it == timersById.end()) {
+        return;
+    }
+    // Destroyed after the lock is released
+    callback = std::move(it->second->second.callback);
+    timers.erase(it->second);
+    timersById.erase(it);
+}
+
+std::atomic<TimerSource *> TimerSource::sInstance{nullptr};
+
+TimerSource::~TimerSource()
+{
+}
+
+TimerSource *TimerSource::instance()
+{
+    TimerSource *source = sInstance.load(std::memory_order_acquire);
+    return source ? source : &systemTimerSource;
+}
+
+void TimerSource::setInstance(TimerSource *source)
+{
+    sInstance.store(source, std::memory_order_release);
+}
+
+VirtualTimerSource::VirtualTimerSource(bool autoAdvance)
+    : d(new Private)
+{
+    d->autoAdvance = autoAdvance;
+    if (!autoAdvance) {
+        return;
+    }
+    auto dispatcher = QAbstractEventDispatcher::instance();
+    if (!dispatcher) {
+        return;
+    }
+    // Advancing from a queued call rather than from within aboutToBlock()
+    // also wakes up the event loop again.
+    d->aboutToBlock = QObject::connect(dispatcher, &QAbstractEventDispatcher::aboutToBlock, &d->context, [this] {
+        {
+            QMutexLocker locker(&d->mutex);
+            if (d->advanceQueued || d->timers.empty()) {
+                return;
+            }
+            d->advanceQueued = true;
+        }
+        QTimer::singleShot(0, &d->context, [this] {
+            {
+                QMutexLocker locker(&d->mutex);
+                d->advanceQueued = false;
+            }
+            advanceToNextDeadline();
+        });
+    });
+}
+
+VirtualTimerSource::~VirtualTimerSource()
+{
+    if (instance() == this) {
+        setInstance(nullptr);
+    }
+    QObject::disconnect(d->aboutToBlock);
+    for (const auto &timer : d->timers) {
+        QObject::disconnect(timer.second.contextDestroyed);
+    }
+}
+
+qint64 VirtualTimerSource::now() const
+{
+    QMutexLocker locker(&d->mutex);
+    return d->now;
+}
+
+void VirtualTimerSource::singleShot(int msecs, const QObject *context, const Callback &callback)
+{
+    QMutexLocker locker(&d->mutex);
+    const quint64 id = ++d->lastId;
+    const auto it = d->timers.emplace(d->now + qMax(msecs, 0), Private::Timer{id, callback, {}});
+    if (context) {
+        d->timersById.emplace(id, it);
+        Private *const priv = d.get();
+        it->second.contextDestroyed = QObject::connect(context, &QObject::destroyed, [priv, id] {
+            priv->stop(id);
+        });
+    }
+}
+
+void VirtualTimerSource::advance(qint64 msecs)
+{
+    qint64 target;
+    {
+        QMutexLocker locker(&d->mutex);
+        target = d->now + qMax<qint64>(msecs, 0);
+    }
+    while (d->fireNext(target)) {
+    }
+    QMutexLocker locker(&d->mutex);
+    d->now = qMax(d->now, target);
+}
+
+bool VirtualTimerSource::advanceToNextDeadline()
+{
+    qint64 deadline;
+    {
+        QMutexLocker locker(&d->mutex);
+        if (d->timers.empty()) {
+            return false;
+        }
+        deadline = d->timers.begin()->first;
+    }
+    while (d->fireNext(deadline)) {
+    }
+    return true;
+}
+
+int VirtualTimerSource::pendingTimers() const
+{
+    QMutexLocker locker(&d->mutex);
+    return static_cast<int>(d->timers.size());
+}
@@ -0,0 +1,134 @@
+/*
+    SPDX-FileCopyrightText: 2026 KAsync contributors
+
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#ifndef KASYNC_TIMERSOURCE_H
+#define KASYNC_TIMERSOURCE_H
+
+#include "kasync_export.h"
+
+#include <QtGlobal>
+
+#include <atomic>
+#include <functional>
+#include <memory>
+
+class QObject;
+
+namespace KAsync {
+
+/**
+ * @brief Clock and timers used by KAsync::wait().
+ *
+ * By default timers are QTimer single shots running in the event loop of
+ * the calling thread, and the time is taken from a monotonic clock. Another
+ * source can be installed with setInstance(), e.g. a VirtualTimerSource to
+ * run simulations of wait-heavy jobs without actually waiting.
+ */
+class KASYNC_EXPORT TimerSource
+{
+public:
+    using Callback = std::function<void()>;
+
+    virtual ~TimerSource();
+
+    /**
+     * Returns the current time in milliseconds since an arbitrary epoch.
+     */
+    virtual qint64 now() const = 0;
+
+    /**
+     * Invokes @p callback once, after @p msecs milliseconds have passed.
+     *
+     * Like with QTimer::singleShot(), the timer is stopped and the callback
+     * destroyed without being invoked if @p context is destroyed before.
+     */
+    virtual void singleShot(int msecs, const QObject *context, const Callback &callback) = 0;
+
+    /**
+     * Invokes @p callback once, after @p msecs milliseconds have passed.
+     */
+    void singleShot(int msecs, const Callback &callback)
+    {
+        singleShot(msecs, nullptr, callback);
+    }
+
+    /**
+     * Returns the installed timer source.
+     */
+    static TimerSource *instance();
+
+    /**
+     * Installs @p source, which is not taken ownership of. Passing nullptr
+     * restores the default source.
+     *
+     * Timers that are already running are not moved to the new source.
+     */
+    static void setInstance(TimerSource *source);
+
+private:
+    static std::atomic<TimerSource *> sInstance;
+};
+
+/**
+ * @brief Deterministic timer source with a virtual clock.
+ *
+ * The clock starts at zero and only moves when advanced, either explicitly
+ * with advance() or, if auto advance is enabled, whenever the event loop of
+ * the thread that created the source is about to block while timers are
+ * pending. In the latter case the clock jumps straight to the next deadline,
+ * so a chain waiting for hours of virtual time finishes as fast as its
+ * continuations run.
+ *
+ * Timers fire in order of their deadline, timers with the same deadline in
+ * the order they were started. Callbacks are invoked from the thread that
+ * advances the clock, so the source is meant for simulations that run in a
+ * single thread. Note that auto advance does not know about other sources
+ * of events, the virtual clock moves on even while the event loop is only
+ * waiting for real timers or I/O.
+ *
+ * Timers that have not fired when the source is destroyed are discarded,
+ * and if the source is still installed, the default source is restored.
+ */
+class KASYNC_EXPORT VirtualTimerSource : public TimerSource
+{
+public:
+    explicit VirtualTimerSource(bool autoAdvance = true);
+    ~VirtualTimerSource() override;
+
+    VirtualTimerSource(const VirtualTimerSource &) = delete;
+    VirtualTimerSource &operator=(const VirtualTimerSource &) = delete;
+
+    using TimerSource::singleShot;
+
+    qint64 now() const override;
+    void singleShot(int msecs, const QObject *context, const Callback &callback) override;
+
+    /**
+     * Moves the clock forward by @p msecs, firing all timers that become
+     * due on the way, including the ones started by the fired callbacks.
+     */
+    void advance(qint64 msecs);
+
+    /**
+     * Moves the clock to the earliest deadline and fires all timers due at
+     * that time. Returns false if no timer is pending.
+     */
+    bool advanceToNextDeadline();
+
+    /**
+     * Returns the number of timers that have neither fired nor been
+     * stopped yet.
+     */
+    int pendingTimers() const;
+
+private:
+    class Private;
+    std::unique_ptr<Private> d;
+};
+
+} // namespace KAsync
+
+#endif // KASYNC_TIMERSOURCE_H